@@ -1,13 +1,24 @@
 #include "public/includes.h"
 
 #include "public/bvh.h"
+#include "public/bvh_cache.h"
 #include "public/camera.h"
+#include "public/compressed_mesh.h"
+#include "public/dynamic_bvh.h"
 #include "public/hittable.h"
 #include "public/hittable_list.h"
+#include "public/instance.h"
+#include "public/linear_bvh.h"
+#include "public/mesh_loader.h"
 #include "public/sphere.h"
+#include "public/sphere_batch.h"
 #include "public/texture.h"
+#include "public/triangle_mesh.h"
+#include "public/wide_bvh.h"
 
-void bouncing_spheres()
+#include <chrono>
+
+hittable_list bouncing_spheres_world()
 {
     hittable_list world;
 
@@ -57,8 +68,11 @@ void bouncing_spheres()
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    return world;
+}
 
+camera bouncing_spheres_camera()
+{
     camera cam;
 
     cam.aspect_ratio      = 16.0 / 9.0;
@@ -74,9 +88,327 @@ void bouncing_spheres()
     cam.defocus_angle = 0.6;
     cam.focus_dist    = 10.0;
 
+    return cam;
+}
+
+void bouncing_spheres()
+{
+    const auto world = hittable_list(make_shared<linear_bvh>(bouncing_spheres_world()));
+
+    camera cam = bouncing_spheres_camera();
+    cam.render(world);
+}
+
+/// Count the nodes the original bvh_node traversal visited for a ray: it tested both children of every node whose box the ray entered,
+/// always over the full ray interval.
+size_t unordered_node_visits(const hittable &object, const ray &r)
+{
+    const auto *node = dynamic_cast<const bvh_node *>(&object);
+    if (node == nullptr) return 0;
+    if (!node->bounding_box().hit(r, interval(0.001, infinity))) return 1;
+
+    if (node->is_leaf()) return 1;
+
+    return 1 + unordered_node_visits(*node->left_child(), r) + unordered_node_visits(*node->right_child(), r);
+}
+
+const char *split_method_name(const bvh_split_method split_method)
+{
+    switch (split_method)
+    {
+        case bvh_split_method::median: return "Median split";
+        case bvh_split_method::sah: return "SAH split";
+        case bvh_split_method::morton: return "Morton split";
+        case bvh_split_method::sbvh: return "Spatial split";
+    }
+    return "";
+}
+
+void bvh_traversal_benchmark(const bvh_split_method split_method, const int treelet_passes = 0)
+{
+    // Traces one camera ray per pixel of bouncing_spheres, plus one scattered ray from every hit, and reports the BVH nodes visited per ray
+    // by bvh_node::hit, next to what the unordered, full-interval traversal would have visited.
+    bvh_build_options options;
+    options.split_method     = split_method;
+    options.treelet_passes   = treelet_passes;
+    options.print_build_time = true;
+    options.print_stats      = true;
+
+    const auto root = make_shared<bvh_node>(bouncing_spheres_world(), options);
+
+    camera cam = bouncing_spheres_camera();
+    cam.initialize();
+
+    size_t rays[2]             = {};
+    size_t ordered_visits[2]   = {};
+    size_t unordered_visits[2] = {};
+
+    for (int j = 0; j < static_cast<int>(cam.image_width / cam.aspect_ratio); j++)
+    {
+        for (int i = 0; i < cam.image_width; i++)
+        {
+            cam.seed_sample(i, j, 0);
+            ray r = cam.get_ray(i, j);
+
+            for (int bounce = 0; bounce < 2; bounce++)
+            {
+                hit_record rec;
+                const auto visits_before = thread_traversal_stats().node_visits;
+                const bool hit           = root->hit(r, interval(0.001, infinity), rec);
+
+                rays[bounce]++;
+                ordered_visits[bounce] += thread_traversal_stats().node_visits - visits_before;
+                unordered_visits[bounce] += unordered_node_visits(*root, r);
+
+                ray   scattered;
+                color attenuation;
+                if (!hit || !rec.mat->scatter(r, rec, attenuation, scattered)) break;
+                r = scattered;
+            }
+        }
+    }
+
+    std::clog << split_method_name(split_method);
+    if (treelet_passes > 0) std::clog << " with " << treelet_passes << " treelet passes";
+    std::clog << ":\n";
+
+    const char *labels[2] = {"Camera rays:   ", "Scattered rays:"};
+    for (int bounce = 0; bounce < 2; bounce++)
+    {
+        const double ordered   = static_cast<double>(ordered_visits[bounce]) / rays[bounce];
+        const double unordered = static_cast<double>(unordered_visits[bounce]) / rays[bounce];
+
+        std::clog << labels[bounce] << ' ' << rays[bounce] << " rays, " << unordered << " -> " << ordered << " node visits per ray ("
+                  << 100.0 * (1.0 - ordered / unordered) << "% fewer)\n";
+    }
+}
+
+void bvh_build_benchmark()
+{
+    // Builds both BVH variants over a million small random spheres, first on one thread and then on every hardware thread, so the
+    // build times show how construction scales with cores.
+    hittable_list world;
+
+    const auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    for (int n = 0; n < 1000000; n++) { world.add(make_shared<sphere>(point3::random(-100, 100), random_double(0.05, 0.5), material)); }
+
+    for (const auto split_method : {bvh_split_method::median, bvh_split_method::sah, bvh_split_method::morton})
+    {
+        for (const int thread_count : {1, 0})
+        {
+            bvh_build_options options;
+            options.split_method     = split_method;
+            options.thread_count     = thread_count;
+            options.print_build_time = true;
+
+            std::clog << split_method_name(split_method) << ": ";
+            bvh_node root(world, options);
+        }
+    }
+}
+
+std::vector<ray> bouncing_spheres_rays(const hittable &world)
+{
+    // One camera ray per pixel of bouncing_spheres, each followed by the ray it scatters into if it hits something.
+    camera cam = bouncing_spheres_camera();
+    cam.initialize();
+
+    std::vector<ray> rays;
+    for (int j = 0; j < static_cast<int>(cam.image_width / cam.aspect_ratio); j++)
+    {
+        for (int i = 0; i < cam.image_width; i++)
+        {
+            cam.seed_sample(i, j, 0);
+            const ray r = cam.get_ray(i, j);
+            rays.push_back(r);
+
+            hit_record rec;
+            ray        scattered;
+            color      attenuation;
+            if (world.hit(r, interval(0.001, infinity), rec) && rec.mat->scatter(r, rec, attenuation, scattered)) rays.push_back(scattered);
+        }
+    }
+    return rays;
+}
+
+void measure_traversal(const char *label, const hittable &bvh, const std::vector<ray> &rays)
+{
+    // Traces every ray ten times and reports the BVH work and time each one took.
+    constexpr int repeats = 10;
+
+    const traversal_stats before = thread_traversal_stats();
+    const auto            start  = std::chrono::steady_clock::now();
+    size_t                hits   = 0;
+    for (int repeat = 0; repeat < repeats; repeat++)
+    {
+        for (const ray &r : rays)
+        {
+            hit_record rec;
+            hits += bvh.hit(r, interval(0.001, infinity), rec);
+        }
+    }
+    const double          seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const traversal_stats work    = thread_traversal_stats() - before;
+    const double          traced  = static_cast<double>(repeats * rays.size());
+
+    std::clog << label << ' ' << work.node_visits / traced << " node visits and " << work.primitive_tests / traced << " primitive tests per ray, "
+              << 1e9 * seconds / traced << " ns per ray, " << hits / repeats << " hits\n";
+}
+
+void wide_bvh_benchmark()
+{
+    // Traces the camera rays of bouncing_spheres, plus one scattered ray from every hit, through the binary BVH layouts and the 4- and
+    // 8-wide ones built from the same SAH tree, and reports node visits per ray and trace time for each.
+    bvh_build_options options;
+    options.split_method = bvh_split_method::sah;
+
+    const bvh_node root(bouncing_spheres_world(), options);
+    const auto     rays = bouncing_spheres_rays(root);
+
+    measure_traversal("bvh_node:  ", root, rays);
+    measure_traversal("linear_bvh:", linear_bvh(root), rays);
+    measure_traversal("bvh4:      ", bvh4(root), rays);
+    measure_traversal("bvh8:      ", bvh8(root), rays);
+}
+
+void sphere_batch_benchmark()
+{
+    // Builds SAH BVHs over the spheres of bouncing_spheres one by one and packed into sphere_batch groups of four and eight, then traces
+    // the same rays through each and reports the tree statistics, BVH work and time per ray.
+    bvh_build_options options;
+    options.split_method = bvh_split_method::sah;
+    options.print_stats  = true;
+
+    const hittable_list world = bouncing_spheres_world();
+    const bvh_node      root(world, options);
+    const auto          rays = bouncing_spheres_rays(root);
+    measure_traversal("Single spheres:", root, rays);
+
+    for (const int batch_size : {4, 8})
+    {
+        const hittable_list packed = sphere_batch::pack(world, batch_size);
+        std::clog << "Batches of up to " << batch_size << ": " << packed.objects.size() << " objects. ";
+
+        options.max_leaf_size = 1;
+        const bvh_node batched(packed, options);
+        measure_traversal("Sphere batches:", batched, rays);
+    }
+}
+
+void bvh_refit_benchmark()
+{
+    // Animates a cloud of drifting spheres over several frames, updating a dynamic_bvh each frame, and reports the time and SAH cost of
+    // every update next to a full rebuild of the same frame.
+    hittable_list                  world;
+    std::vector<shared_ptr<sphere> > spheres;
+    std::vector<point3>              starts;
+    std::vector<vec3>                velocities;
+
+    const auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    for (int n = 0; n < 200000; n++)
+    {
+        starts.push_back(point3::random(-100, 100));
+        velocities.push_back(vec3::random(-0.25, 0.25));
+        spheres.push_back(make_shared<sphere>(starts.back(), random_double(0.05, 0.5), material));
+        world.add(spheres.back());
+    }
+
+    bvh_build_options options;
+    options.split_method = bvh_split_method::sah;
+
+    dynamic_bvh bvh(world, options, 0.25);
+
+    for (int frame = 1; frame <= 10; frame++)
+    {
+        // Each frame's shutter spans from this frame's position to the next one.
+        for (size_t n = 0; n < spheres.size(); n++) { spheres[n]->move(starts[n] + frame * velocities[n], starts[n] + (frame + 1) * velocities[n]); }
+
+        const auto update_start   = std::chrono::steady_clock::now();
+        const bool rebuilt        = bvh.update();
+        const auto update_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - update_start).count();
+
+        const auto     rebuild_start   = std::chrono::steady_clock::now();
+        const bvh_node fresh(world, options);
+        const auto     rebuild_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - rebuild_start).count();
+
+        std::clog << "Frame " << frame << ": " << (rebuilt ? "rebuilt" : "refit") << " in " << update_seconds << " seconds, SAH cost "
+                  << bvh.tree().sah_cost(options) << "; full rebuild " << rebuild_seconds << " seconds, SAH cost " << fresh.sah_cost(options)
+                  << "\n";
+    }
+}
+
+void instanced_spheres()
+{
+    // One small model, a spiral of spheres, is built into a BVH once and placed thousands of times. The top-level BVH holds only the
+    // instances, each of which is a transform and a pointer to the shared model BVH.
+    hittable_list model;
+
+    const shared_ptr<material> gold  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.1);
+    const shared_ptr<material> matte = make_shared<lambertian>(color(0.2, 0.3, 0.7));
+    for (int k = 0; k < 12; k++)
+    {
+        const double angle = k * pi / 6;
+        model.add(make_shared<sphere>(point3(std::cos(angle), 0.25 + 0.15 * k, std::sin(angle)), 0.25, k % 2 ? gold : matte));
+    }
+
+    const auto model_bvh = make_shared<bvh_node>(model);
+
+    hittable_list instances;
+    for (int a = -40; a < 40; a++)
+    {
+        for (int b = -40; b < 40; b++)
+        {
+            const auto place = affine_transform::translation(vec3(3 * a + random_double(0, 1.5), 0, 3 * b + random_double(0, 1.5)))
+                               * affine_transform::rotation(vec3(0, 1, 0), random_double(0, 360)) * affine_transform::scaling(random_double(0.4, 0.8));
+            instances.add(make_shared<instance>(model_bvh, place));
+        }
+    }
+
+    bvh_build_options options;
+    options.split_method = bvh_split_method::sah;
+
+    hittable_list world;
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+    world.add(make_shared<bvh_node>(instances, options));
+
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+
+    cam.vFov     = 30;
+    cam.lookFrom = point3(20, 8, 20);
+    cam.lookAt   = point3(0, 0, 0);
+    cam.vUp      = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
     cam.render(world);
 }
 
+void bvh_cache_benchmark()
+{
+    // Asks the BVH cache for the same million-sphere scene twice: the first request builds and saves the hierarchy unless an earlier run
+    // already did, and the second maps it straight from disk.
+    hittable_list world;
+
+    const auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    for (int n = 0; n < 1000000; n++) { world.add(make_shared<sphere>(point3::random(-100, 100), random_double(0.05, 0.5), material)); }
+
+    bvh_build_options options;
+    options.split_method = bvh_split_method::sah;
+
+    for (int run = 0; run < 2; run++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto bvh   = cached_linear_bvh(world, "bvh_cache", options);
+        std::clog << "Startup took " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " seconds for "
+                  << bvh->node_array().size() << " nodes.\n";
+    }
+}
+
 void checkered_spheres()
 {
     hittable_list world;
@@ -126,6 +458,200 @@ void earth()
     cam.render(hittable_list(globe));
 }
 
+shared_ptr<mesh_buffers> torus_mesh(const point3 &center, const double major_radius, const double minor_radius, const int rings,
+                                    const int sides, const bool smooth)
+{
+    // A torus around the Y axis, split into rings segments around that axis and sides segments around its tube, two triangles per
+    // quad. The seams repeat their first row and column of vertices so the texture coordinates can run all the way to 1.
+    auto mesh = make_shared<mesh_buffers>();
+    for (int ring = 0; ring <= rings; ring++)
+    {
+        const double theta = 2 * pi * ring / rings;
+        const vec3   out(std::cos(theta), 0, std::sin(theta));
+        for (int side = 0; side <= sides; side++)
+        {
+            const double phi    = 2 * pi * side / sides;
+            const vec3   normal = std::cos(phi) * out + vec3(0, std::sin(phi), 0);
+
+            mesh->positions.push_back(center + major_radius * out + minor_radius * normal);
+            if (smooth) mesh->normals.push_back(normal);
+            mesh->uvs.push_back(static_cast<double>(ring) / rings);
+            mesh->uvs.push_back(static_cast<double>(side) / sides);
+        }
+    }
+
+    for (int ring = 0; ring < rings; ring++)
+    {
+        for (int side = 0; side < sides; side++)
+        {
+            const auto v00 = static_cast<uint32_t>(ring * (sides + 1) + side);
+            const auto v10 = v00 + static_cast<uint32_t>(sides + 1);
+            mesh->indices.insert(mesh->indices.end(), {v00, v00 + 1, v10, v10, v00 + 1, v10 + 1});
+        }
+    }
+    return mesh;
+}
+
+void triangle_meshes()
+{
+    // A smooth, textured torus of about 100k triangles and a coarse, flat shaded metal one, over the checkered ground of bouncing_spheres.
+    hittable_list world;
+
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(0.0, -1000.0, 0.0), 1000.0, make_shared<lambertian>(checker)));
+
+    auto stripes = make_shared<checker_texture>(0.15, color(0.8, 0.3, 0.1), color(0.9, 0.9, 0.8));
+    world.add(make_shared<triangle_mesh>(torus_mesh(point3(-1.2, 0.6, 0), 1.2, 0.6, 400, 128, true), make_shared<lambertian>(stripes)));
+    world.add(make_shared<triangle_mesh>(torus_mesh(point3(1.6, 0.5, -2.2), 0.9, 0.5, 24, 12, false),
+                                         make_shared<metal>(color(0.7, 0.6, 0.5), 0.05)));
+
+    camera cam = bouncing_spheres_camera();
+    cam.lookFrom      = point3(10, 6, 6);
+    cam.lookAt        = point3(0, 0.3, -0.5);
+    cam.defocus_angle = 0;
+
+    cam.render(hittable_list(make_shared<linear_bvh>(world)));
+}
+
+std::vector<ray> torus_rays()
+{
+    // Rays from all around the origin at points inside the bounds of a torus_mesh of radii 1.2 and 0.6 centered there.
+    std::vector<ray> rays;
+    for (int n = 0; n < 200000; n++)
+    {
+        const point3 origin = 6 * random_unit_vector();
+        rays.emplace_back(origin, point3(random_double(-1.8, 1.8), random_double(-0.6, 0.6), random_double(-1.8, 1.8)) - origin);
+    }
+    return rays;
+}
+
+void triangle_leaf_benchmark()
+{
+    // Builds a torus of about 100k triangles with each leaf layout, and with indexed leaves allowed as many triangles as packed4, then
+    // traces the same torus_rays through each and reports memory, BVH work and time per ray.
+    const auto mesh     = torus_mesh(point3(0, 0, 0), 1.2, 0.6, 400, 128, true);
+    const auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    const auto rays     = torus_rays();
+
+    const struct
+    {
+        const char          *label;
+        triangle_leaf_layout layout;
+        int                  max_leaf_size;
+    } variants[] = {
+        {"Indexed, 2:", triangle_leaf_layout::indexed, 2},
+        {"Indexed, 4:", triangle_leaf_layout::indexed, 4},
+        {"Packed4:   ", triangle_leaf_layout::packed4, 4},
+        {"Packed8:   ", triangle_leaf_layout::packed8, 8},
+    };
+    for (const auto &variant : variants)
+    {
+        bvh_build_options options;
+        options.max_leaf_size = variant.max_leaf_size;
+
+        const triangle_mesh model(mesh, material, options, variant.layout);
+        std::clog << variant.label << ' ' << model.node_array().size() << " nodes, " << model.memory_bytes() / 1024 << " KiB\n";
+        measure_traversal(variant.label, model, rays);
+    }
+}
+
+void compressed_mesh_benchmark()
+{
+    // Compresses a smooth, textured torus of about 100k triangles with several cluster sizes, and reports the memory of each next to the
+    // uncompressed mesh, with its BVH work and time per ray for the same torus_rays.
+    const auto          mesh     = torus_mesh(point3(0, 0, 0), 1.2, 0.6, 400, 128, true);
+    const auto          material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    const triangle_mesh model(mesh, material);
+    const auto          rays     = torus_rays();
+
+    std::clog << "Uncompressed: " << mesh->memory_bytes() / 1024 << " KiB of buffers, " << model.memory_bytes() / 1024
+              << " KiB of hierarchy\n";
+    measure_traversal("Uncompressed:", model, rays);
+
+    for (const int cluster_size : {16, 64, 255})
+    {
+        const auto            start   = std::chrono::steady_clock::now();
+        const compressed_mesh compressed(*mesh, material, cluster_size);
+        const double          seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::clog << "Clusters of up to " << cluster_size << ": " << compressed.cluster_count() << " clusters, "
+                  << compressed.memory_bytes() / 1024 << " KiB, built in " << seconds << " seconds\n";
+        measure_traversal("Compressed:  ", compressed, rays);
+    }
+}
+
+void mesh_model(const std::string &path)
+{
+    // Loads an OBJ or PLY model and renders it in grey on a checkered floor, with the camera framing its bounding box.
+    const auto mesh = load_mesh(path);
+    if (mesh == nullptr) return;
+
+    hittable_list world;
+    auto          model = make_shared<triangle_mesh>(mesh, make_shared<lambertian>(color(0.7, 0.7, 0.7)));
+    const aabb    box   = model->bounding_box();
+    world.add(model);
+
+    const point3 center((box.x.min + box.x.max) / 2, (box.y.min + box.y.max) / 2, (box.z.min + box.z.max) / 2);
+    const double size = std::max({box.x.size(), box.y.size(), box.z.size()});
+
+    auto checker = make_shared<checker_texture>(size / 8, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(center.x(), box.y.min - 1000 * size, center.z()), 1000 * size, make_shared<lambertian>(checker)));
+
+    camera cam = bouncing_spheres_camera();
+    cam.lookAt        = center;
+    cam.lookFrom      = center + 2.5 * size * unit_vector(vec3(1, 0.6, 1.2));
+    cam.vFov          = 30;
+    cam.defocus_angle = 0;
+
+    cam.render(hittable_list(make_shared<linear_bvh>(world)));
+}
+
+void spatial_split_benchmark()
+{
+    // Builds SAH and spatial split BVHs over spheres whose radii span more than two orders of magnitude, so that the large ones overlap
+    // many small ones, and reports the statistics of each tree, with its node visits per ray and trace time for rays shot into the cloud.
+    hittable_list world;
+
+    const auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    for (int n = 0; n < 100000; n++)
+    {
+        const double radius = 0.05 * std::pow(400.0, std::pow(random_double(), 4.0));
+        world.add(make_shared<sphere>(point3::random(-100, 100), radius, material));
+    }
+
+    std::vector<ray> rays;
+    for (int n = 0; n < 200000; n++)
+    {
+        const point3 origin = point3::random(-100, 100) + vec3(0, 0, -300);
+        rays.emplace_back(origin, unit_vector(point3::random(-100, 100) - origin));
+    }
+
+    for (const auto split_method : {bvh_split_method::sah, bvh_split_method::sbvh})
+    {
+        bvh_build_options options;
+        options.split_method     = split_method;
+        options.print_build_time = true;
+        options.print_stats      = true;
+
+        std::clog << split_method_name(split_method) << ": ";
+        const bvh_node root(world, options);
+
+        const traversal_stats before = thread_traversal_stats();
+        const auto            start  = std::chrono::steady_clock::now();
+        size_t                hits   = 0;
+        for (const ray &r : rays)
+        {
+            hit_record rec;
+            hits += root.hit(r, interval(0.001, infinity), rec);
+        }
+        const double          seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const traversal_stats work    = thread_traversal_stats() - before;
+
+        std::clog << "     " << static_cast<double>(work.node_visits) / rays.size() << " node visits and "
+                  << static_cast<double>(work.primitive_tests) / rays.size() << " primitive tests per ray, " << 1e9 * seconds / rays.size()
+                  << " ns per ray, " << hits << " hits\n";
+    }
+}
+
 int main()
 {
     switch (3)
@@ -136,5 +662,34 @@ int main()
             break;
         case 3: earth();
             break;
+        case 4: bvh_traversal_benchmark(bvh_split_method::median);
+            bvh_traversal_benchmark(bvh_split_method::sah);
+            bvh_traversal_benchmark(bvh_split_method::morton);
+            bvh_traversal_benchmark(bvh_split_method::sbvh);
+            bvh_traversal_benchmark(bvh_split_method::median, 3);
+            bvh_traversal_benchmark(bvh_split_method::morton, 3);
+            break;
+        case 5: bvh_build_benchmark();
+            break;
+        case 6: wide_bvh_benchmark();
+            break;
+        case 7: bvh_refit_benchmark();
+            break;
+        case 8: instanced_spheres();
+            break;
+        case 9: bvh_cache_benchmark();
+            break;
+        case 10: spatial_split_benchmark();
+            break;
+        case 11: sphere_batch_benchmark();
+            break;
+        case 12: triangle_meshes();
+            break;
+        case 13: mesh_model("Models/model.ply");
+            break;
+        case 14: triangle_leaf_benchmark();
+            break;
+        case 15: compressed_mesh_benchmark();
+            break;
     }
 }
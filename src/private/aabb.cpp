@@ -1,5 +1,7 @@
 #include "aabb.h"
 
+#include "simd.h"
+
 aabb::aabb(const interval &x, const interval &y, const interval &z)
         : x(x),
           y(y),
@@ -54,6 +56,36 @@ bool aabb::hit(const ray &r, interval ray_t) const
     return true;
 }
 
+uint32_t aabb::hit_packet(const ray_packet &rays, const double t_min, const double *t_max, const uint32_t lane_mask) const
+{
+    uint32_t result = 0;
+
+    for (int base = 0; base < rays.size; base += 4)
+    {
+        if ((lane_mask >> base & 0xFu) == 0) continue;
+
+        f64x4 t_enter = f64x4::broadcast(t_min);
+        f64x4 t_exit  = f64x4::load(t_max + base);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const interval &ax    = axis_interval(axis);
+            const f64x4     orig  = f64x4::load(rays.origin[axis] + base);
+            const f64x4     adinv = f64x4::load(rays.inv_direction[axis] + base);
+
+            const f64x4 t0 = (f64x4::broadcast(ax.min) - orig) * adinv;
+            const f64x4 t1 = (f64x4::broadcast(ax.max) - orig) * adinv;
+
+            t_enter = max(t_enter, min(t0, t1));
+            t_exit  = min(t_exit, max(t0, t1));
+        }
+
+        result |= static_cast<uint32_t>((t_enter < t_exit).movemask()) << base;
+    }
+
+    return result & lane_mask;
+}
+
 int aabb::longest_axis() const
 {
     // Returns the index of the longest axis of the bounding box
@@ -61,3 +93,17 @@ int aabb::longest_axis() const
         return x.size() > z.size() ? 0 : 2;
     return y.size() > z.size() ? 1 : 2;
 }
+
+double aabb::surface_area() const
+{
+    const double dx = x.size(), dy = y.size(), dz = z.size();
+    if (dx < 0 || dy < 0 || dz < 0) return 0;
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+aabb aabb::overlap(const aabb &other) const
+{
+    return {interval(std::fmax(x.min, other.x.min), std::fmin(x.max, other.x.max)),
+            interval(std::fmax(y.min, other.y.min), std::fmin(y.max, other.y.max)),
+            interval(std::fmax(z.min, other.z.min), std::fmin(z.max, other.z.max))};
+}
@@ -1,8 +1,16 @@
 #include "bvh.h"
 
+#include "bvh_stats.h"
+#include "morton.h"
+#include "parallel.h"
 
-bvh_node::bvh_node(hittable_list list)
-    : bvh_node(list.objects, 0, list.objects.size())
+#include <bit>
+#include <chrono>
+#include <thread>
+
+
+bvh_node::bvh_node(hittable_list list, const bvh_build_options &options)
+    : bvh_node(list.objects, 0, list.objects.size(), options)
 {
     // There's a C++ subtlety here. This constructor (without span indices) creates an
     // implicit copy of the hittable list, which we will modify. The lifetime of the copied
@@ -10,53 +18,761 @@ bvh_node::bvh_node(hittable_list list)
     // persist the resulting bounding volume hierarchy.
 }
 
-bvh_node::bvh_node(std::vector<shared_ptr<hittable> > &objects, size_t start, size_t end)
+bvh_node::bvh_node(std::vector<shared_ptr<hittable> > &objects, size_t start, size_t end, const bvh_build_options &options)
+{
+    const auto build_start = std::chrono::steady_clock::now();
+    const int  threads     = worker_count(options.thread_count);
+
+    auto primitives = make_build_primitives(objects, start, end, threads);
+    if (options.split_method == bvh_split_method::morton)
+    {
+        const auto codes = sort_by_morton_code(primitives, options, threads);
+        build_morton(primitives, codes, 0, primitives.size(), options, threads);
+    } else if (options.split_method == bvh_split_method::sbvh)
+    {
+        const double root_area = bound_span(primitives, 0, primitives.size(), threads).box.surface_area();
+        auto         budget    = static_cast<size_t>(std::max(options.spatial_budget, 0.0) * static_cast<double>(primitives.size()));
+        build_spatial(std::move(primitives), options, root_area, budget, 0);
+    } else
+    {
+        build(primitives, 0, primitives.size(), options, threads);
+    }
+
+    // Spatial splits are built on this thread alone, whatever the thread count.
+    const auto build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+    const int  build_threads = options.split_method == bvh_split_method::sbvh ? 1 : threads;
+    if (options.print_build_time)
+    {
+        std::clog << "Built BVH over " << end - start << " objects in " << build_seconds << " seconds on " << build_threads
+                  << " threads.\n";
+    }
+
+    if (options.treelet_passes > 0)
+    {
+        const auto   optimize_start = std::chrono::steady_clock::now();
+        const double built_cost     = sah_cost(options);
+
+        optimize(options);
+
+        const auto optimize_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - optimize_start).count();
+        if (options.print_build_time)
+        {
+            std::clog << "Optimized BVH from SAH cost " << built_cost << " to " << sah_cost(options) << " in " << optimize_seconds
+                      << " seconds.\n";
+        }
+    }
+
+    if (options.print_stats) bvh_stats(*this, options).print(std::clog);
+}
+
+bvh_node::bvh_node(std::vector<build_primitive> &primitives, size_t start, size_t end, const bvh_build_options &options, const int threads)
+{
+    build(primitives, start, end, options, threads);
+}
+
+/// @return How many chunks to cut a span into when several threads share it: a few per thread, so uneven chunks still balance.
+static size_t chunk_count(const size_t span, const int threads) { return threads > 1 ? std::min(span, static_cast<size_t>(threads) * 4) : 1; }
+
+/// @return The first index of chunk number chunk out of chunks equal parts of [start, end).
+static size_t chunk_start(const size_t start, const size_t end, const size_t chunk, const size_t chunks)
+{
+    return start + (end - start) * chunk / chunks;
+}
+
+void bvh_node::build(std::vector<build_primitive> &primitives, size_t start, size_t end, const bvh_build_options &options, const int threads)
+{
+    const size_t object_span  = end - start;
+    const size_t leaf_size    = static_cast<size_t>(std::clamp(options.max_leaf_size, 1, 0xFFFF));
+    const int    span_threads = (object_span >= options.parallel_threshold) ? threads : 1;
+
+    const span_bounds bounds = bound_span(primitives, start, end, span_threads);
+
+    bbox = bounds.box;
+    axis = bbox.longest_axis();
+
+    size_t mid = end;
+    if (options.split_method == bvh_split_method::sah) { mid = split_sah(primitives, start, end, bounds.centroids, options, span_threads); }
+    else if (object_span > leaf_size) { mid = split_median(primitives, start, end); }
+
+    if (mid == start || mid == end)
+    {
+        objects.reserve(object_span);
+        for (size_t object_index = start; object_index < end; object_index++) { objects.push_back(primitives[object_index].object); }
+        return;
+    }
+
+    if (span_threads < 2)
+    {
+        left  = shared_ptr<bvh_node>(new bvh_node(primitives, start, mid, options, 1));
+        right = shared_ptr<bvh_node>(new bvh_node(primitives, mid, end, options, 1));
+        return;
+    }
+
+    // The children own disjoint spans of primitives, so they can be built concurrently. Share the threads out by object count.
+    const auto left_share   = static_cast<int>(static_cast<double>(span_threads) * static_cast<double>(mid - start) / object_span + 0.5);
+    const int  left_threads = std::clamp(left_share, 1, span_threads - 1);
+
+    std::thread left_builder([&] { left = shared_ptr<bvh_node>(new bvh_node(primitives, start, mid, options, left_threads)); });
+    right = shared_ptr<bvh_node>(new bvh_node(primitives, mid, end, options, span_threads - left_threads));
+    left_builder.join();
+}
+
+std::vector<bvh_node::build_primitive> bvh_node::make_build_primitives(const std::vector<shared_ptr<hittable> > &objects, size_t start,
+                                                                       size_t end, const int threads)
+{
+    std::vector<build_primitive> primitives(end - start);
+
+    const size_t chunks = chunk_count(end - start, threads);
+    parallel_for(chunks, threads, [&](const size_t chunk)
+    {
+        for (size_t object_index = chunk_start(start, end, chunk, chunks); object_index < chunk_start(start, end, chunk + 1, chunks); object_index++)
+        {
+            const aabb box                  = objects[object_index]->bounding_box();
+            primitives[object_index - start] = {objects[object_index], box,
+                                                point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2};
+        }
+    });
+
+    return primitives;
+}
+
+bvh_node::span_bounds bvh_node::bound_span(const std::vector<build_primitive> &primitives, size_t start, size_t end, const int threads)
+{
+    const size_t             chunks = chunk_count(end - start, threads);
+    std::vector<span_bounds> partial(chunks);
+
+    parallel_for(chunks, threads, [&](const size_t chunk)
+    {
+        span_bounds &bounds = partial[chunk];
+        for (size_t object_index = chunk_start(start, end, chunk, chunks); object_index < chunk_start(start, end, chunk + 1, chunks); object_index++)
+        {
+            const build_primitive &primitive = primitives[object_index];
+            bounds.box                       = aabb(bounds.box, primitive.box);
+            bounds.centroids                 = aabb(bounds.centroids, aabb(primitive.centroid, primitive.centroid));
+        }
+    });
+
+    span_bounds bounds;
+    for (const auto &chunk_bounds : partial)
+    {
+        bounds.box       = aabb(bounds.box, chunk_bounds.box);
+        bounds.centroids = aabb(bounds.centroids, chunk_bounds.centroids);
+    }
+
+    return bounds;
+}
+
+std::vector<uint64_t> bvh_node::sort_by_morton_code(std::vector<build_primitive> &primitives, const bvh_build_options &options, const int threads)
 {
-    // Build the bounding box of the span of source objects.
-    bbox = aabb::empty;
-    for (size_t object_index = start; object_index < end; object_index++) { bbox = aabb(bbox, objects[object_index]->bounding_box()); }
+    const size_t count  = primitives.size();
+    const int    bits   = std::clamp(options.morton_bits, 1, 21);
+    const auto   bounds = bound_span(primitives, 0, count, count >= options.parallel_threshold ? threads : 1);
+
+    struct keyed
+    {
+        uint64_t code;
+        uint32_t index;
+    };
+
+    std::vector<keyed> keys(count), scratch(count);
+
+    const size_t chunks = chunk_count(count, count >= options.parallel_threshold ? threads : 1);
+    parallel_for(chunks, threads, [&](const size_t chunk)
+    {
+        for (size_t index = chunk_start(0, count, chunk, chunks); index < chunk_start(0, count, chunk + 1, chunks); index++)
+        {
+            // x takes the highest bit of every triple, then y, then z.
+            uint64_t code = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const interval &extent = bounds.centroids.axis_interval(axis);
+                const double    offset = extent.size() > 0 ? (primitives[index].centroid[axis] - extent.min) / extent.size() : 0.0;
+                const auto      cell   = static_cast<uint64_t>(std::clamp(offset * (1 << bits), 0.0, (1 << bits) - 1.0));
+                code |= spread_bits(cell) << (2 - axis);
+            }
+            keys[index] = {code, static_cast<uint32_t>(index)};
+        }
+    });
 
-    const int axis = bbox.longest_axis();
+    // Least significant digit radix sort, a byte per pass, over only the bytes the codes use.
+    for (int shift = 0; shift < 3 * bits; shift += 8)
+    {
+        size_t offsets[257] = {};
+        for (const keyed &key : keys) { offsets[(key.code >> shift & 0xff) + 1]++; }
+        for (int digit = 0; digit < 256; digit++) { offsets[digit + 1] += offsets[digit]; }
+        for (const keyed &key : keys) { scratch[offsets[key.code >> shift & 0xff]++] = key; }
+        keys.swap(scratch);
+    }
 
-    const auto comparator = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
+    std::vector<build_primitive> sorted(count);
+    std::vector<uint64_t>        codes(count);
+    for (size_t index = 0; index < count; index++)
+    {
+        sorted[index] = std::move(primitives[keys[index].index]);
+        codes[index]  = keys[index].code;
+    }
+    primitives.swap(sorted);
+
+    return codes;
+}
 
+void bvh_node::build_morton(std::vector<build_primitive> &primitives, const std::vector<uint64_t> &codes, size_t start, size_t end,
+                            const bvh_build_options &options, const int threads)
+{
     const size_t object_span = end - start;
+    const size_t leaf_size   = static_cast<size_t>(std::clamp(options.max_leaf_size, 1, 0xFFFF));
+
+    if (object_span <= leaf_size)
+    {
+        bbox = aabb::empty;
+        objects.reserve(object_span);
+        for (size_t object_index = start; object_index < end; object_index++)
+        {
+            bbox = aabb(bbox, primitives[object_index].box);
+            objects.push_back(primitives[object_index].object);
+        }
+        return;
+    }
 
-    if (object_span == 1) { left = right = objects[start]; } else if (object_span == 2)
+    // The codes are sorted, so the span's first and last codes differ in the highest bit that differs anywhere in it, and every code from
+    // the first with that bit set onwards belongs on the upper side. Identical codes carry no order, so split those down the middle.
+    size_t mid = start + object_span / 2;
+    axis       = -1;
+    if (codes[start] != codes[end - 1])
     {
-        left  = objects[start];
-        right = objects[start + 1];
+        const int split_bit = 63 - std::countl_zero(codes[start] ^ codes[end - 1]);
+        mid                 = static_cast<size_t>(std::partition_point(codes.begin() + start, codes.begin() + end,
+                                                                       [split_bit](const uint64_t code) { return (code >> split_bit & 1) == 0; })
+                                                  - codes.begin());
+        axis                = 2 - split_bit % 3;
+    }
+
+    left  = shared_ptr<bvh_node>(new bvh_node());
+    right = shared_ptr<bvh_node>(new bvh_node());
+
+    const int span_threads = (object_span >= options.parallel_threshold) ? threads : 1;
+    if (span_threads < 2)
+    {
+        left->build_morton(primitives, codes, start, mid, options, 1);
+        right->build_morton(primitives, codes, mid, end, options, 1);
+    } else
+    {
+        const auto left_share   = static_cast<int>(static_cast<double>(span_threads) * static_cast<double>(mid - start) / object_span + 0.5);
+        const int  left_threads = std::clamp(left_share, 1, span_threads - 1);
+
+        std::thread left_builder([&] { left->build_morton(primitives, codes, start, mid, options, left_threads); });
+        right->build_morton(primitives, codes, mid, end, options, span_threads - left_threads);
+        left_builder.join();
+    }
+
+    bbox = aabb(left->bbox, right->bbox);
+    if (axis < 0) axis = bbox.longest_axis();
+}
+
+/// @return box with its interval along axis cut down to [min, max].
+static aabb clip_box(const aabb &box, const int axis, const double min, const double max)
+{
+    interval slabs[3] = {box.x, box.y, box.z};
+    slabs[axis]       = interval(std::max(slabs[axis].min, min), std::min(slabs[axis].max, max));
+    return {slabs[0], slabs[1], slabs[2]};
+}
+
+void bvh_node::build_spatial(std::vector<build_primitive> references, const bvh_build_options &options, const double root_area, size_t &budget,
+                             const int depth)
+{
+    const size_t      count  = references.size();
+    const span_bounds bounds = bound_span(references, 0, count, 1);
+
+    bbox = bounds.box;
+    axis = bbox.longest_axis();
+
+    double       object_cost = infinity;
+    const size_t mid         = split_sah(references, 0, count, bounds.centroids, options, 1, &object_cost);
+    if (mid == 0 || mid == count)
+    {
+        objects.reserve(count);
+        for (const auto &reference : references) objects.push_back(reference.object);
+        return;
+    }
+
+    // Spatial splits only pay off where the object split leaves its children overlapping, and pricing them is the expensive part of
+    // the build, so skip them in nodes where the overlap is small next to the whole scene.
+    const double overlap = bound_span(references, 0, mid, 1).box.overlap(bound_span(references, mid, count, 1).box).surface_area();
+
+    struct bin
+    {
+        aabb   box     = aabb::empty;
+        size_t entries = 0; // References whose box starts in this bin
+        size_t exits   = 0; // References whose box ends in this bin
+    };
+
+    const int    bin_count    = std::max(options.sah_bins, 2);
+    const double node_area    = std::max(bbox.surface_area(), 1e-12);
+    double       spatial_cost = infinity;
+    int          spatial_axis = 0;
+    int          spatial_bin  = 0;
+    size_t       duplicates   = 0;
+
+    if (depth < max_spatial_depth && budget > 0 && overlap > options.spatial_alpha * root_area)
+    {
+        for (int bin_axis = 0; bin_axis < 3; bin_axis++)
+        {
+            const interval &extent = bbox.axis_interval(bin_axis);
+            if (extent.size() <= 0) continue;
+
+            const double bin_width = extent.size() / bin_count;
+            const auto   bin_index = [&](const double x) { return std::clamp(static_cast<int>((x - extent.min) / bin_width), 0, bin_count - 1); };
+
+            // A reference is clipped to the slab of every bin it crosses, so each bin's box only grows by what really lies inside it.
+            std::vector<bin> bins(bin_count);
+            for (const auto &reference : references)
+            {
+                const interval &span  = reference.box.axis_interval(bin_axis);
+                const int       first = bin_index(span.min);
+                const int       last  = bin_index(span.max);
+                for (int b = first; b <= last; b++)
+                {
+                    const aabb clipped = clip_box(reference.box, bin_axis, extent.min + b * bin_width, extent.min + (b + 1) * bin_width);
+                    bins[b].box        = aabb(bins[b].box, clipped);
+                }
+                bins[first].entries++;
+                bins[last].exits++;
+            }
+
+            std::vector<double> right_cost(bin_count, 0.0);
+            std::vector<size_t> right_counts(bin_count, 0);
+            aabb                right_box   = aabb::empty;
+            size_t              right_count = 0;
+            for (int b = bin_count - 1; b > 0; b--)
+            {
+                right_box = aabb(right_box, bins[b].box);
+                right_count += bins[b].exits;
+                right_counts[b] = right_count;
+                right_cost[b]   = right_count > 0 ? right_box.surface_area() * static_cast<double>(right_count) : 0.0;
+            }
+
+            aabb   left_box   = aabb::empty;
+            size_t left_count = 0;
+            for (int b = 1; b < bin_count; b++)
+            {
+                left_box = aabb(left_box, bins[b - 1].box);
+                left_count += bins[b - 1].entries;
+
+                // Both sides must shrink, or the split only copies references into a child no simpler than this node.
+                if (left_count == 0 || right_counts[b] == 0 || left_count == count || right_counts[b] == count) continue;
+
+                const double cost = options.traversal_cost
+                                    + options.intersection_cost * (left_box.surface_area() * static_cast<double>(left_count) + right_cost[b]) / node_area;
+                if (cost < spatial_cost)
+                {
+                    spatial_cost = cost;
+                    spatial_axis = bin_axis;
+                    spatial_bin  = b;
+                    duplicates   = left_count + right_counts[b] - count;
+                }
+            }
+        }
+    }
+
+    std::vector<build_primitive> left_references, right_references;
+    if (spatial_cost < object_cost && duplicates <= budget)
+    {
+        const interval &extent    = bbox.axis_interval(spatial_axis);
+        const double    bin_width = extent.size() / bin_count;
+        const double    plane     = extent.min + spatial_bin * bin_width;
+        const auto      bin_index = [&](const double x) { return std::clamp(static_cast<int>((x - extent.min) / bin_width), 0, bin_count - 1); };
+
+        budget -= duplicates;
+        axis = spatial_axis;
+
+        for (auto &reference : references)
+        {
+            const interval &span = reference.box.axis_interval(spatial_axis);
+            if (bin_index(span.max) < spatial_bin) { left_references.push_back(reference); }
+            else if (bin_index(span.min) >= spatial_bin) { right_references.push_back(reference); }
+            else
+            {
+                // The reference straddles the plane: each side gets the part of its box on that side.
+                const aabb left_part  = clip_box(reference.box, spatial_axis, span.min, plane);
+                const aabb right_part = clip_box(reference.box, spatial_axis, plane, span.max);
+                left_references.push_back({reference.object, left_part,
+                                           point3(left_part.x.min + left_part.x.max, left_part.y.min + left_part.y.max,
+                                                  left_part.z.min + left_part.z.max) / 2});
+                right_references.push_back({reference.object, right_part,
+                                            point3(right_part.x.min + right_part.x.max, right_part.y.min + right_part.y.max,
+                                                   right_part.z.min + right_part.z.max) / 2});
+            }
+        }
     } else
     {
-        std::sort(objects.begin() + start, objects.begin() + end, comparator);
+        left_references.assign(references.begin(), references.begin() + static_cast<std::ptrdiff_t>(mid));
+        right_references.assign(references.begin() + static_cast<std::ptrdiff_t>(mid), references.end());
+    }
+
+    // The children take over from here; drop this level's references before recursing so only one path's worth stays alive.
+    std::vector<build_primitive>().swap(references);
+
+    left  = shared_ptr<bvh_node>(new bvh_node());
+    right = shared_ptr<bvh_node>(new bvh_node());
+    left->build_spatial(std::move(left_references), options, root_area, budget, depth + 1);
+    right->build_spatial(std::move(right_references), options, root_area, budget, depth + 1);
+}
+
+size_t bvh_node::split_median(std::vector<build_primitive> &primitives, size_t start, size_t end) const
+{
+    // Only the median has to land in place, with the lower objects before it, so a selection is enough; no need for a full sort.
+    const size_t mid       = start + (end - start) / 2;
+    const int    sort_axis = axis;
+    std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+                     [sort_axis](const build_primitive &a, const build_primitive &b) {
+                         return a.box.axis_interval(sort_axis).min < b.box.axis_interval(sort_axis).min;
+                     });
+
+    return mid;
+}
+
+size_t bvh_node::split_sah(std::vector<build_primitive> &primitives, size_t start, size_t end, const aabb &centroid_bounds,
+                           const bvh_build_options &options, const int threads, double *split_cost)
+{
+    if (split_cost != nullptr) *split_cost = infinity;
+
+    const size_t object_span = end - start;
+    const size_t leaf_size   = static_cast<size_t>(std::clamp(options.max_leaf_size, 1, 0xFFFF));
+    const double leaf_cost   = options.intersection_cost * static_cast<double>(object_span);
+
+    if (object_span == 1) return end;
 
-        auto mid = start + object_span / 2;
-        left     = make_shared<bvh_node>(objects, start, mid);
-        right    = make_shared<bvh_node>(objects, mid, end);
+    // Bin by centroid rather than by box, so large objects don't all land in the outer buckets.
+    const int       split_axis = centroid_bounds.longest_axis();
+    const interval &extent     = centroid_bounds.axis_interval(split_axis);
+
+    // Every centroid sits at the same spot along the widest axis, so no bucket boundary can separate them.
+    if (extent.size() <= 0) return object_span <= leaf_size ? end : split_median(primitives, start, end);
+
+    struct bin
+    {
+        aabb   box   = aabb::empty;
+        size_t count = 0;
+    };
+
+    const int bin_count = std::max(options.sah_bins, 2);
+
+    const auto bin_index = [&](const build_primitive &primitive) {
+        const double offset = (primitive.centroid[split_axis] - extent.min) / extent.size();
+        return std::min(static_cast<int>(offset * bin_count), bin_count - 1);
+    };
+
+    // Each chunk fills its own set of bins, which are then merged.
+    const size_t                   chunks = chunk_count(object_span, threads);
+    std::vector<std::vector<bin> > partial(chunks, std::vector<bin>(bin_count));
+
+    parallel_for(chunks, threads, [&](const size_t chunk)
+    {
+        for (size_t object_index = chunk_start(start, end, chunk, chunks); object_index < chunk_start(start, end, chunk + 1, chunks); object_index++)
+        {
+            bin &b = partial[chunk][bin_index(primitives[object_index])];
+            b.box  = aabb(b.box, primitives[object_index].box);
+            b.count++;
+        }
+    });
+
+    std::vector<bin> bins(bin_count);
+    for (const auto &chunk_bins : partial)
+    {
+        for (int b = 0; b < bin_count; b++)
+        {
+            bins[b].box = aabb(bins[b].box, chunk_bins[b].box);
+            bins[b].count += chunk_bins[b].count;
+        }
+    }
+
+    // Sweep from the right to gather the area-weighted count above each boundary, then from the left to price every split.
+    std::vector<double> right_cost(bin_count, 0.0);
+    aabb                right_box   = aabb::empty;
+    size_t              right_count = 0;
+    for (int b = bin_count - 1; b > 0; b--)
+    {
+        right_box = aabb(right_box, bins[b].box);
+        right_count += bins[b].count;
+        right_cost[b] = right_count > 0 ? right_box.surface_area() * static_cast<double>(right_count) : 0.0;
     }
+
+    const double node_area = std::max(bbox.surface_area(), 1e-12);
+
+    aabb   left_box   = aabb::empty;
+    size_t left_count = 0;
+    double best_cost  = infinity;
+    int    best_split = 0;
+    for (int b = 1; b < bin_count; b++)
+    {
+        left_box = aabb(left_box, bins[b - 1].box);
+        left_count += bins[b - 1].count;
+        if (left_count == 0 || left_count == object_span) continue;
+
+        const double cost = options.traversal_cost
+                            + options.intersection_cost * (left_box.surface_area() * static_cast<double>(left_count) + right_cost[b]) / node_area;
+        if (cost < best_cost)
+        {
+            best_cost  = cost;
+            best_split = b;
+        }
+    }
+
+    if (object_span <= leaf_size && leaf_cost <= best_cost) return end;
+
+    axis = split_axis;
+    if (split_cost != nullptr) *split_cost = best_cost;
+
+    const auto mid = std::partition(primitives.begin() + start, primitives.begin() + end,
+                                    [&](const build_primitive &primitive) { return bin_index(primitive) < best_split; });
+
+    // The centroids may still straddle no boundary if they all fall in one bucket; fall back to an even split.
+    const size_t split = static_cast<size_t>(mid - primitives.begin());
+    if (best_split == 0 || split == start || split == end)
+    {
+        if (split_cost != nullptr) *split_cost = infinity;
+        axis = bbox.longest_axis();
+        return split_median(primitives, start, end);
+    }
+
+    return split;
 }
 
 bool bvh_node::hit(const ray &r, const interval ray_t, hit_record &rec) const
 {
+    traversal_stats &stats = thread_traversal_stats();
+    stats.node_visits++;
     if (!bbox.hit(r, ray_t)) return false;
 
-    const bool hit_left  = left->hit(r, ray_t, rec);
-    const bool hit_right = right->hit(r, ray_t, rec);
+    if (is_leaf())
+    {
+        stats.primitive_tests += objects.size();
+
+        bool hit_anything   = false;
+        auto closest_so_far = ray_t.max;
+
+        for (const auto &object : objects)
+        {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), rec))
+            {
+                hit_anything   = true;
+                closest_so_far = rec.t;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    // The children were split along axis with left holding the lower part, so a ray heading down that axis reaches right first.
+    const bool  right_first = r.direction()[axis] < 0;
+    const auto &near_child  = right_first ? right : left;
+    const auto &far_child   = right_first ? left : right;
+
+    const bool hit_near = near_child->hit(r, ray_t, rec);
+    const bool hit_far  = far_child->hit(r, interval(ray_t.min, hit_near ? rec.t : ray_t.max), rec);
+
+    return hit_near || hit_far;
+}
+
+void bvh_node::hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const
+{
+    // Only the lanes that enter this node's box carry on into its children. Each lane counts as its own visit and tests.
+    traversal_stats &stats = thread_traversal_stats();
+    stats.node_visits += std::popcount(lane_mask);
+
+    const uint32_t lanes = bbox.hit_packet(rays, t_min, hits.t_max, lane_mask);
+    if (lanes == 0) return;
+
+    if (is_leaf())
+    {
+        stats.primitive_tests += static_cast<uint64_t>(std::popcount(lanes)) * objects.size();
+        for (const auto &object : objects) { object->hit_packet(rays, t_min, lanes, hits); }
+        return;
+    }
+
+    // Coherent rays share direction signs, so order the children by the first active lane.
+    const bool  right_first = rays.direction[axis][std::countr_zero(lanes)] < 0;
+    const auto &near_child  = right_first ? right : left;
+    const auto &far_child   = right_first ? left : right;
 
-    return hit_left || hit_right;
+    near_child->hit_packet(rays, t_min, lanes, hits);
+    far_child->hit_packet(rays, t_min, lanes, hits);
 }
 
 aabb bvh_node::bounding_box() const { return bbox; }
 
-static bool box_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b, const int axis_index)
+void bvh_node::refit()
+{
+    if (is_leaf())
+    {
+        bbox = aabb::empty;
+        for (const auto &object : objects) { bbox = aabb(bbox, object->bounding_box()); }
+        return;
+    }
+
+    left->refit();
+    right->refit();
+    bbox = aabb(left->bbox, right->bbox);
+}
+
+double bvh_node::sah_cost(const bvh_build_options &options) const
 {
-    const auto a_axis_interval = a->bounding_box().axis_interval(axis_index);
-    const auto b_axis_interval = b->bounding_box().axis_interval(axis_index);
-    return a_axis_interval.min < b_axis_interval.min;
+    const double root_area = bbox.surface_area();
+    return root_area > 0 ? area_weighted_cost(options) / root_area : 0.0;
 }
 
-bool bvh_node::box_x_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b) { return box_compare(a, b, 0); }
+double bvh_node::area_weighted_cost(const bvh_build_options &options) const
+{
+    if (is_leaf()) return bbox.surface_area() * options.intersection_cost * static_cast<double>(objects.size());
+
+    return bbox.surface_area() * options.traversal_cost + left->area_weighted_cost(options) + right->area_weighted_cost(options);
+}
+
+void bvh_node::optimize(const bvh_build_options &options)
+{
+    const int threads = worker_count(options.thread_count);
+    for (int pass = 0; pass < options.treelet_passes; pass++) optimize_subtree(options, threads);
+}
 
-bool bvh_node::box_y_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b) { return box_compare(a, b, 1); }
+double bvh_node::optimize_subtree(const bvh_build_options &options, const int threads)
+{
+    if (is_leaf()) return subtree_cost = area_weighted_cost(options);
+
+    double left_cost, right_cost;
+    if (threads > 1)
+    {
+        // Treelets never reach above their root, so the two subtrees can be restructured at the same time.
+        std::thread left_optimizer([&] { left_cost = left->optimize_subtree(options, threads / 2); });
+        right_cost = right->optimize_subtree(options, threads - threads / 2);
+        left_optimizer.join();
+    } else
+    {
+        left_cost  = left->optimize_subtree(options, 1);
+        right_cost = right->optimize_subtree(options, 1);
+    }
+
+    return subtree_cost = restructure_treelet(options, left_cost, right_cost);
+}
+
+double bvh_node::restructure_treelet(const bvh_build_options &options, const double left_cost, const double right_cost)
+{
+    const int leaf_limit = std::clamp(options.treelet_size, 3, max_treelet_size);
+
+    // Grow the treelet from this node's children by opening the leaf with the largest area, the one rays are most likely to enter.
+    shared_ptr<bvh_node> leaves[max_treelet_size]     = {left, right};
+    double               leaf_costs[max_treelet_size] = {left_cost, right_cost};
+    shared_ptr<bvh_node> spare_nodes[max_treelet_size];
+    int                  leaf_count   = 2;
+    int                  spare_count  = 0;
+    double               current_cost = bbox.surface_area() * options.traversal_cost;
+
+    while (leaf_count < leaf_limit)
+    {
+        int    widest = -1;
+        double area   = -1;
+        for (int k = 0; k < leaf_count; k++)
+        {
+            if (!leaves[k]->is_leaf() && leaves[k]->bbox.surface_area() > area)
+            {
+                widest = k;
+                area   = leaves[k]->bbox.surface_area();
+            }
+        }
 
-bool bvh_node::box_z_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b) { return box_compare(a, b, 2); }
+        if (widest < 0) break;
+
+        shared_ptr<bvh_node> opened = leaves[widest];
+        current_cost += opened->bbox.surface_area() * options.traversal_cost;
+
+        leaves[widest]             = opened->left;
+        leaf_costs[widest]         = opened->left->subtree_cost;
+        leaves[leaf_count]         = opened->right;
+        leaf_costs[leaf_count++]   = opened->right->subtree_cost;
+        spare_nodes[spare_count++] = std::move(opened);
+    }
+
+    for (int k = 0; k < leaf_count; k++) current_cost += leaf_costs[k];
+    if (leaf_count < 3) return current_cost;
+
+    // Cheapest tree over every subset of the leaves, smallest subsets first. A subset's root costs its area whichever way it is split,
+    // so only the split of the remaining cost needs searching.
+    const int subset_count = 1 << leaf_count;
+    aabb      subset_box[1 << max_treelet_size];
+    double    subset_cost[1 << max_treelet_size];
+    int       subset_split[1 << max_treelet_size];
+
+    subset_box[0] = aabb::empty;
+    for (int subset = 1; subset < subset_count; subset++)
+    {
+        // Every split keeps the lowest leaf on the first side and some proper part of the rest with it, so each is visited once.
+        const int lowest = subset & -subset;
+        const int rest   = subset ^ lowest;
+
+        subset_box[subset] = aabb(subset_box[rest], leaves[std::countr_zero(static_cast<unsigned>(lowest))]->bbox);
+
+        if (rest == 0)
+        {
+            subset_cost[subset] = leaf_costs[std::countr_zero(static_cast<unsigned>(lowest))];
+            continue;
+        }
+
+        double    best   = infinity;
+        int       split  = 0;
+        for (int others = (rest - 1) & rest;; others = (others - 1) & rest)
+        {
+            const int    part = lowest | others;
+            const double cost = subset_cost[part] + subset_cost[subset ^ part];
+            if (cost < best)
+            {
+                best  = cost;
+                split = part;
+            }
+
+            if (others == 0) break;
+        }
+
+        subset_cost[subset]  = best + subset_box[subset].surface_area() * options.traversal_cost;
+        subset_split[subset] = split;
+    }
+
+    const int    everything = subset_count - 1;
+    const double best_cost  = subset_cost[everything];
+    if (best_cost >= current_cost * (1 - 1e-9)) return current_cost;
+
+    // Rebuild the treelet in the cheaper shape, reusing the interior nodes it opened up.
+    const auto assemble = [&](const auto &self, const int subset) -> shared_ptr<bvh_node>
+    {
+        if (std::has_single_bit(static_cast<unsigned>(subset))) return leaves[std::countr_zero(static_cast<unsigned>(subset))];
+
+        shared_ptr<bvh_node> node = std::move(spare_nodes[--spare_count]);
+        node->set_children(self(self, subset_split[subset]), self(self, subset ^ subset_split[subset]));
+        node->subtree_cost = subset_cost[subset];
+        return node;
+    };
+
+    set_children(assemble(assemble, subset_split[everything]), assemble(assemble, everything ^ subset_split[everything]));
+    return best_cost;
+}
+
+void bvh_node::set_children(shared_ptr<bvh_node> first, shared_ptr<bvh_node> second)
+{
+    const aabb &a = first->bbox;
+    const aabb &b = second->bbox;
+
+    axis          = 0;
+    double widest = -1;
+    for (int n = 0; n < 3; n++)
+    {
+        const double separation = fabs((b.axis_interval(n).min + b.axis_interval(n).max) - (a.axis_interval(n).min + a.axis_interval(n).max));
+        if (separation > widest)
+        {
+            widest = separation;
+            axis   = n;
+        }
+    }
+
+    const bool swap = a.axis_interval(axis).min + a.axis_interval(axis).max > b.axis_interval(axis).min + b.axis_interval(axis).max;
+    left            = swap ? std::move(second) : std::move(first);
+    right           = swap ? std::move(first) : std::move(second);
+    bbox            = aabb(left->bbox, right->bbox);
+}
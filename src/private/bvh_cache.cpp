@@ -0,0 +1,222 @@
+#include "bvh_cache.h"
+
+#include "mapped_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+
+/// The first bytes of every cache file. Written in native byte order, so byte_order reads back differently on a machine of the other
+/// endianness.
+struct bvh_cache_header
+{
+    char     magic[8];        // "LRTBVH" and two zero bytes
+    uint32_t version;         // bvh_cache_version
+    uint32_t byte_order;      // 0x01020304
+    uint32_t node_size;       // sizeof(linear_bvh_node)
+    uint32_t padding;
+    uint64_t scene_hash;      // bvh_scene_hash of the scene and build options
+    uint64_t node_count;      // Nodes, starting right after the header
+    uint64_t primitive_count; // uint32_t object indices, starting right after the nodes
+};
+
+static_assert(std::is_trivially_copyable_v<linear_bvh_node>, "linear_bvh_node is written and mapped as raw bytes");
+static_assert(sizeof(bvh_cache_header) % alignof(linear_bvh_node) == 0, "nodes must stay aligned after the header");
+
+static constexpr char     cache_magic[8]   = {'L', 'R', 'T', 'B', 'V', 'H', 0, 0};
+static constexpr uint32_t cache_byte_order = 0x01020304;
+
+/// FNV-1a over raw bytes.
+static uint64_t hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+template<typename T>
+static uint64_t hash_value(const uint64_t hash, const T &value)
+{
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+uint64_t bvh_scene_hash(const hittable_list &list, const bvh_build_options &options)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    hash = hash_value(hash, bvh_cache_version);
+    hash = hash_value(hash, static_cast<int>(options.split_method));
+    hash = hash_value(hash, options.max_leaf_size);
+    hash = hash_value(hash, options.sah_bins);
+    hash = hash_value(hash, options.traversal_cost);
+    hash = hash_value(hash, options.intersection_cost);
+    hash = hash_value(hash, options.morton_bits);
+    hash = hash_value(hash, options.treelet_passes);
+    hash = hash_value(hash, options.treelet_size);
+    hash = hash_value(hash, options.spatial_alpha);
+    hash = hash_value(hash, options.spatial_budget);
+    hash = hash_value(hash, static_cast<uint64_t>(list.objects.size()));
+
+    for (const auto &object : list.objects)
+    {
+        const aabb   box       = object->bounding_box();
+        const double bounds[6] = {box.x.min, box.x.max, box.y.min, box.y.max, box.z.min, box.z.max};
+        hash                   = hash_bytes(hash, bounds, sizeof(bounds));
+    }
+
+    return hash;
+}
+
+bool save_bvh_cache(const std::string &path, const linear_bvh &bvh, const hittable_list &list, const uint64_t scene_hash)
+{
+    std::unordered_map<const hittable *, uint32_t> object_index;
+    object_index.reserve(list.objects.size());
+    for (size_t index = 0; index < list.objects.size(); index++) object_index.emplace(list.objects[index].get(), static_cast<uint32_t>(index));
+
+    std::vector<uint32_t> primitive_indices;
+    primitive_indices.reserve(bvh.primitive_array().size());
+    for (const auto &primitive : bvh.primitive_array())
+    {
+        const auto found = object_index.find(primitive.get());
+        if (found == object_index.end())
+        {
+            std::cerr << "ERROR: BVH cache " << path << " not written: the hierarchy holds an object that is not in the scene.\n";
+            return false;
+        }
+        primitive_indices.push_back(found->second);
+    }
+
+    bvh_cache_header header = {};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version         = bvh_cache_version;
+    header.byte_order      = cache_byte_order;
+    header.node_size       = sizeof(linear_bvh_node);
+    header.scene_hash      = scene_hash;
+    header.node_count      = bvh.node_array().size();
+    header.primitive_count = primitive_indices.size();
+
+    const std::string scratch_path = path + ".tmp";
+    {
+        std::ofstream file(scratch_path, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "ERROR: Could not open BVH cache file " << scratch_path << ".\n";
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(bvh.node_array().data()), static_cast<std::streamsize>(bvh.node_array().size_bytes()));
+        file.write(reinterpret_cast<const char *>(primitive_indices.data()), static_cast<std::streamsize>(primitive_indices.size() * sizeof(uint32_t)));
+
+        if (!file)
+        {
+            std::cerr << "ERROR: Could not write BVH cache file " << scratch_path << ".\n";
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(scratch_path, path, error);
+    if (error)
+    {
+        std::cerr << "ERROR: Could not move BVH cache file into place at " << path << ".\n";
+        std::remove(scratch_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/// @return True if every interior node's children lie after it in the array, so traversal only ever moves forward, and every leaf's
+/// primitives lie inside the primitive array. Cache files are input like any other, and a corrupt one must not send traversal astray.
+static bool valid_cache_nodes(const std::span<const linear_bvh_node> nodes, const uint64_t primitive_count)
+{
+    for (size_t index = 0; index < nodes.size(); index++)
+    {
+        const linear_bvh_node &node = nodes[index];
+        if (node.prim_count > 0)
+        {
+            if (static_cast<uint64_t>(node.offset) + node.prim_count > primitive_count) return false;
+        } else if (index + 1 >= nodes.size() || node.offset <= index + 1 || node.offset >= nodes.size() || node.axis > 2)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+shared_ptr<linear_bvh> load_bvh_cache(const std::string &path, const hittable_list &list, const uint64_t scene_hash)
+{
+    auto mapping = make_shared<const mapped_file>(path);
+    if (!mapping->is_open() || mapping->size() < sizeof(bvh_cache_header)) return nullptr;
+
+    bvh_cache_header header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != bvh_cache_version
+        || header.byte_order != cache_byte_order || header.node_size != sizeof(linear_bvh_node) || header.scene_hash != scene_hash)
+    {
+        return nullptr;
+    }
+
+    if (header.node_count > mapping->size() / sizeof(linear_bvh_node) || header.primitive_count > mapping->size() / sizeof(uint32_t))
+    {
+        return nullptr;
+    }
+
+    const size_t node_bytes      = header.node_count * sizeof(linear_bvh_node);
+    const size_t primitive_bytes = header.primitive_count * sizeof(uint32_t);
+    if (mapping->size() != sizeof(header) + node_bytes + primitive_bytes) return nullptr;
+
+    // Page-aligned mappings and an aligned header size keep the nodes aligned where they lie.
+    const std::span<const linear_bvh_node> nodes(reinterpret_cast<const linear_bvh_node *>(mapping->data() + sizeof(header)),
+                                                 header.node_count);
+    if (!valid_cache_nodes(nodes, header.primitive_count))
+    {
+        std::cerr << "ERROR: BVH cache " << path << " holds nodes that point outside it.\n";
+        return nullptr;
+    }
+
+    const unsigned char               *indices = mapping->data() + sizeof(header) + node_bytes;
+    std::vector<shared_ptr<hittable> > primitives(header.primitive_count);
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        uint32_t index;
+        std::memcpy(&index, indices + i * sizeof(uint32_t), sizeof(index));
+        if (index >= list.objects.size()) return nullptr;
+        primitives[i] = list.objects[index];
+    }
+
+    auto bvh = make_shared<linear_bvh>(mapping, nodes, std::move(primitives));
+    if (bvh->node_array().size() != nodes.size()) return nullptr; // Too deep to traverse, and already reported
+    return bvh;
+}
+
+shared_ptr<linear_bvh> cached_linear_bvh(const hittable_list &list, const std::string &cache_directory, const bvh_build_options &options)
+{
+    const auto     load_start = std::chrono::steady_clock::now();
+    const uint64_t scene_hash = bvh_scene_hash(list, options);
+
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "%016llx.bvh", static_cast<unsigned long long>(scene_hash));
+    const std::string path = (std::filesystem::path(cache_directory) / file_name).string();
+
+    if (auto cached = load_bvh_cache(path, list, scene_hash))
+    {
+        const auto load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+        std::clog << "Loaded BVH over " << list.objects.size() << " objects from " << path << " in " << load_seconds << " seconds.\n";
+        return cached;
+    }
+
+    auto built = make_shared<linear_bvh>(list, options);
+
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory, error);
+    if (save_bvh_cache(path, *built, list, scene_hash)) std::clog << "Saved BVH cache " << path << ".\n";
+
+    return built;
+}
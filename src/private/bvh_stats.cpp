@@ -0,0 +1,70 @@
+#include "bvh_stats.h"
+
+#include "linear_bvh.h"
+
+bvh_stats::bvh_stats(const bvh_node &root, const bvh_build_options &options)
+{
+    add_node(root, 0);
+
+    sah_cost     = root.sah_cost(options);
+    mean_overlap = (interior_count > 0) ? mean_overlap / static_cast<double>(interior_count) : 0.0;
+    linear_bytes = (interior_count + leaf_count) * sizeof(linear_bvh_node) + reference_count * sizeof(shared_ptr<hittable>);
+}
+
+void bvh_stats::add_node(const bvh_node &node, const size_t depth)
+{
+    node_bytes += sizeof(bvh_node);
+
+    if (node.is_leaf())
+    {
+        const size_t size = node.leaf_objects().size();
+
+        leaf_count++;
+        reference_count += size;
+        node_bytes += node.leaf_objects().capacity() * sizeof(shared_ptr<hittable>);
+
+        if (leaf_depths.size() <= depth) leaf_depths.resize(depth + 1);
+        if (leaf_sizes.size() <= size) leaf_sizes.resize(size + 1);
+        leaf_depths[depth]++;
+        leaf_sizes[size]++;
+        return;
+    }
+
+    interior_count++;
+
+    const double area    = node.bounding_box().surface_area();
+    const double overlap = node.left_child()->bounding_box().overlap(node.right_child()->bounding_box()).surface_area();
+    if (area > 0)
+    {
+        mean_overlap += overlap / area; // Summed here, divided by the interior count once the walk is done
+        max_overlap = std::max(max_overlap, overlap / area);
+    }
+
+    add_node(*node.left_child(), depth + 1);
+    add_node(*node.right_child(), depth + 1);
+}
+
+/// Writes the nonzero entries of a histogram as "index: count" pairs on one line.
+static void print_histogram(std::ostream &out, const char *label, const std::vector<size_t> &histogram)
+{
+    out << label;
+    for (size_t index = 0; index < histogram.size(); index++)
+    {
+        if (histogram[index] > 0) out << "  " << index << ": " << histogram[index];
+    }
+    out << '\n';
+}
+
+void bvh_stats::print(std::ostream &out) const
+{
+    size_t min_depth = 0;
+    while (min_depth < leaf_depths.size() && leaf_depths[min_depth] == 0) min_depth++;
+
+    out << "BVH: " << interior_count + leaf_count << " nodes (" << interior_count << " interior, " << leaf_count << " leaves), "
+        << reference_count << " object references, leaf depth " << min_depth << " to " << leaf_depths.size() - 1 << ", SAH cost "
+        << sah_cost << '\n';
+    out << "     sibling overlap " << 100 * mean_overlap << "% of the parent's area on average, " << 100 * max_overlap << "% at most\n";
+    out << "     memory " << node_bytes / 1024 << " KiB as bvh_node, " << linear_bytes / 1024 << " KiB as linear_bvh\n";
+    print_histogram(out, "     leaves by depth:", leaf_depths);
+    print_histogram(out, "     leaves by size: ", leaf_sizes);
+}
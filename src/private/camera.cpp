@@ -1,12 +1,26 @@
 #include "camera.h"
 
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 
 void camera::initialize()
 {
     // Calculate the image height, and ensure that it's at least 1.
-    image_height = ((static_cast<int>(image_width / aspect_ratio)) < 1) ? 1 : image_height;
-
-    pixel_samples_scale = 1.0 / samples_per_pixel;
+    image_height = static_cast<int>(image_width / aspect_ratio);
+    image_height = (image_height < 1) ? 1 : image_height;
 
     center = lookFrom;
 
@@ -44,23 +58,236 @@ void camera::render(const hittable &world)
 {
     initialize();
 
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    framebuffer image(image_width, image_height);
+
+    const bool adaptive     = adaptive_threshold > 0;
+    const int  pass_samples = (samples_per_pass > 0) ? samples_per_pass : (adaptive ? adaptive_min_samples : samples_per_pixel);
+    const auto budget       = static_cast<size_t>(samples_per_pixel) * image_width * image_height;
+
+    std::clog << "Rendering on " << worker_count(thread_count) << " threads.\n";
+
+    const auto render_start = std::chrono::steady_clock::now();
+
+    auto   last_snapshot = std::chrono::steady_clock::now();
+    size_t spent         = 0;
+    size_t active        = count_active_pixels(image);
+
+    last_render_stats = {};
+
+    for (int pass = 1; active > 0 && spent < budget; pass++)
+    {
+        // The first adaptive pass gives every pixel enough samples to estimate its variance. After that, never plan more samples than
+        // the budget has left, spread over the pixels that are still sampling.
+        int samples = (adaptive && pass == 1) ? std::max(adaptive_min_samples, 2) : pass_samples;
+        samples     = static_cast<int>(std::min<size_t>(samples, (budget - spent + active - 1) / active));
+
+        spent += render_pass(world, samples, image, last_render_stats);
+        active = count_active_pixels(image);
+
+        std::clog << "\rPass " << pass << ": " << spent / (image_width * image_height) << " samples per pixel on average, " << active
+                  << " pixels still sampling.        \n";
+
+        if (active == 0 || spent >= budget) break;
+
+        const auto now          = std::chrono::steady_clock::now();
+        const bool passes_due   = snapshot_passes > 0 && pass % snapshot_passes == 0;
+        const bool interval_due = snapshot_seconds > 0 && std::chrono::duration<double>(now - last_snapshot).count() >= snapshot_seconds;
+
+        if (passes_due || interval_due)
+        {
+            write_snapshot(image);
+            last_snapshot = now;
+        }
+    }
+
+#if defined(_WIN32)
+    // Windows opens stdout in text mode, which would turn every 0x0A byte of a binary image into 0x0D 0x0A.
+    std::cout.flush();
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    image.write(std::cout, output_format);
+
+    const auto render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+    std::clog << "\rDone in " << render_seconds << " seconds.                                        \n";
+
+    if (last_render_stats.rays > 0)
+    {
+        const auto rays = static_cast<double>(last_render_stats.rays);
+        std::clog << "Traced " << last_render_stats.rays << " rays: " << last_render_stats.node_visits / rays << " node visits and "
+                  << last_render_stats.primitive_tests / rays << " primitive tests per ray.\n";
+    }
+}
+
+size_t camera::render_pass(const hittable &world, const int sample_count, framebuffer &image, traversal_stats &stats) const
+{
+    const int           tile_edge  = (tile_size < 1) ? 1 : tile_size;
+    const int           tiles_x    = (image_width + tile_edge - 1) / tile_edge;
+    const int           tiles_y    = (image_height + tile_edge - 1) / tile_edge;
+    const auto          tile_count = static_cast<size_t>(tiles_x) * tiles_y;
+    size_t              tiles_left = tile_count;
+    std::atomic<size_t> samples_taken(0);
+    std::mutex          progress_mutex;
+
+    parallel_for(tile_count, thread_count, [&](const size_t tile)
+    {
+        const int x0 = static_cast<int>(tile % tiles_x) * tile_edge;
+        const int y0 = static_cast<int>(tile / tiles_x) * tile_edge;
+
+        // The counters are per thread, and the worker threads may not outlive the pass, so each tile hands in what it added.
+        const traversal_stats stats_before = thread_traversal_stats();
+        samples_taken += render_tile(world, x0, y0, std::min(x0 + tile_edge, image_width), std::min(y0 + tile_edge, image_height), sample_count,
+                                     image);
+        const traversal_stats tile_stats = thread_traversal_stats() - stats_before;
+
+        const std::lock_guard lock(progress_mutex);
+        stats += tile_stats;
+        std::clog << "\rTiles remaining: " << --tiles_left << ' ' << std::flush;
+    });
+
+    return samples_taken;
+}
+
+size_t camera::render_tile(const hittable &world, const int x0, const int y0, const int x1, const int y1, const int sample_count,
+                           framebuffer &image) const
+{
+    const int max_samples = max_pixel_samples();
+
+    // List every sample this tile takes, grouped by pixel and in sample order.
+    std::vector<path_request> requests;
+    for (int j = y0; j < y1; j++)
+    {
+        for (int i = x0; i < x1; i++)
+        {
+            if (!pixel_active(image, i, j)) continue;
+
+            const int first_sample = image.sample_count(i, j);
+            const int last_sample  = std::min(first_sample + sample_count, max_samples);
+            for (int sample = first_sample; sample < last_sample; sample++) { requests.push_back({i, j, sample}); }
+        }
+    }
+
+    std::vector<color> results;
+    if (engine == render_engine::wavefront) { wavefront_integrator(*this).trace(world, requests, results); } else if (packet_size > 0)
+    {
+        trace_packets(world, requests, results);
+    } else
+    {
+        results.resize(requests.size());
+        for (size_t index = 0; index < requests.size(); index++)
+        {
+            seed_sample(requests[index].i, requests[index].j, requests[index].sample);
+            ray r          = get_ray(requests[index].i, requests[index].j);
+            results[index] = ray_color(r, max_depth, world);
+        }
+    }
+
+    // Accumulate each pixel's run of samples.
+    for (size_t first = 0, last = 0; first < requests.size(); first = last)
+    {
+        color  pixel_color(0, 0, 0);
+        double luminance_squares = 0;
+        for (last = first; last < requests.size() && requests[last].i == requests[first].i && requests[last].j == requests[first].j; last++)
+        {
+            const auto brightness = luminance(results[last]);
+
+            pixel_color += results[last];
+            luminance_squares += brightness * brightness;
+        }
+        image.add_samples(requests[first].i, requests[first].j, pixel_color, luminance_squares, static_cast<int>(last - first));
+    }
+
+    return requests.size();
+}
+
+void camera::trace_packets(const hittable &world, const std::vector<path_request> &requests, std::vector<color> &results) const
+{
+    const int lanes = (packet_size <= 4) ? 4 : (packet_size <= 8) ? 8 : max_packet_size;
+    rng       generators[max_packet_size];
+
+    results.resize(requests.size());
+
+    for (size_t first = 0; first < requests.size(); first += lanes)
+    {
+        const int count = static_cast<int>(std::min<size_t>(lanes, requests.size() - first));
+
+        // Generate the camera rays, keeping each sample's random number stream for the rest of its path.
+        ray_packet packet;
+        packet.size = (count + 3) & ~3;
+        for (int lane = 0; lane < count; lane++)
+        {
+            const auto &request = requests[first + lane];
+            seed_sample(request.i, request.j, request.sample);
+            packet.set(lane, get_ray(request.i, request.j));
+            generators[lane] = thread_rng();
+        }
+        for (int lane = count; lane < packet.size; lane++) { packet.set(lane, packet.lane_ray(0)); }
 
+        packet_hit hits;
+        if (max_depth > 0)
+        {
+            thread_traversal_stats().rays += count;
+            world.hit_packet(packet, 0.001, (1u << count) - 1, hits);
+        }
+
+        // The bounced rays scatter in all directions, so every path continues on its own.
+        for (int lane = 0; lane < count; lane++)
+        {
+            thread_rng()          = generators[lane];
+            const auto *first_hit = (hits.hit_mask >> lane & 1u) ? &hits.rec[lane] : nullptr;
+            results[first + lane]  = continue_path(packet.lane_ray(lane), first_hit, max_depth, world);
+        }
+    }
+}
+
+int camera::max_pixel_samples() const
+{
+    if (adaptive_threshold <= 0) return samples_per_pixel;
+    return (adaptive_max_samples > 0) ? adaptive_max_samples : 4 * samples_per_pixel;
+}
+
+bool camera::pixel_active(const framebuffer &image, const int i, const int j) const
+{
+    const int samples = image.sample_count(i, j);
+
+    if (samples >= max_pixel_samples()) return false;
+    if (adaptive_threshold <= 0 || samples < adaptive_min_samples) return true;
+
+    return image.relative_error(i, j) > adaptive_threshold;
+}
+
+size_t camera::count_active_pixels(const framebuffer &image) const
+{
+    size_t active = 0;
     for (int j = 0; j < image_height; j++)
     {
-        std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-        for (int i = 0; i < image_width; i++)
+        for (int i = 0; i < image_width; i++) { active += pixel_active(image, i, j) ? 1 : 0; }
+    }
+    return active;
+}
+
+void camera::write_snapshot(const framebuffer &image) const
+{
+    // Write to a scratch file first, then swap it in, so that anyone watching the snapshot never reads a partial image.
+    const std::string scratch_path = snapshot_path + ".tmp";
+    {
+        std::ofstream file(scratch_path, std::ios::binary);
+        if (!file)
         {
-            color pixel_color(0, 0, 0);
-            for (int sample = 0; sample < samples_per_pixel; sample++)
-            {
-                ray r = get_ray(i, j);
-                pixel_color += ray_color(r, max_depth, world);
-            }
-            write_color(std::cout, pixel_samples_scale * pixel_color);
+            std::cerr << "ERROR: Could not open snapshot file " << scratch_path << ".\n";
+            return;
         }
+        image.write(file, output_format);
     }
-    std::clog << "\rDone.               \n";
+
+    std::error_code error;
+    std::filesystem::rename(scratch_path, snapshot_path, error);
+    if (error) std::cerr << "ERROR: Could not move snapshot file into place at " << snapshot_path << ": " << error.message() << ".\n";
+}
+
+void camera::seed_sample(const int i, const int j, const int sample) const
+{
+    const auto pixel_index = static_cast<uint64_t>(j) * image_width + i;
+    thread_rng().reseed(mix_seed(seed ^ mix_seed(pixel_index)), sample);
 }
 
 vec3 camera::sample_square() { return {random_double() - 0.5, random_double() - 0.5, 0}; }
@@ -87,21 +314,58 @@ ray camera::get_ray(const int i, const int j) const
     return {ray_origin, ray_direction, ray_time};
 }
 
+color camera::background(const ray &r) const
+{
+    const vec3 unit_direction = unit_vector(r.direction());
+    const auto a              = 0.5 * (unit_direction.y() + 1.0);
+
+    return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+}
+
 color camera::ray_color(const ray &r, const int depth, const hittable &world) const
 {
-    // If we exceed the ray bounce limit, no more light is gathered.
     if (depth <= 0) return {0, 0, 0};
 
-    if (hit_record rec; world.hit(r, interval(0.001, infinity), rec))
+    hit_record rec;
+    thread_traversal_stats().rays++;
+    const bool hit = world.hit(r, interval(0.001, infinity), rec);
+
+    return continue_path(r, hit ? &rec : nullptr, depth, world);
+}
+
+color camera::continue_path(const ray &r, const hit_record *first_hit, const int depth, const hittable &world) const
+{
+    color             throughput(1.0, 1.0, 1.0);
+    ray               current = r;
+    hit_record        rec;
+    const hit_record *hit = first_hit;
+
+    for (int bounce = 0; bounce < depth; bounce++)
     {
+        if (bounce > 0)
+        {
+            thread_traversal_stats().rays++;
+            hit = world.hit(current, interval(0.001, infinity), rec) ? &rec : nullptr;
+        }
+        if (hit == nullptr) return throughput * background(current);
+
         ray   scattered;
         color attenuation;
-        if (rec.mat->scatter(r, rec, attenuation, scattered)) return attenuation * ray_color(scattered, depth - 1, world);
-        return {0, 0, 0};
-    }
+        if (!hit->mat->scatter(current, *hit, attenuation, scattered)) return {0, 0, 0};
 
-    const vec3 unit_direction = unit_vector(r.direction());
-    const auto a              = 0.5 * (unit_direction.y() + 1.0);
+        throughput = throughput * attenuation;
+        current    = scattered;
 
-    return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+        // Russian roulette: survive with a probability equal to the brightest throughput channel, then compensate for the paths
+        // that were ended so that the estimate stays unbiased.
+        if (bounce + 1 >= rr_min_depth)
+        {
+            const double survival = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 1.0);
+            if (random_double() >= survival) return {0, 0, 0};
+            throughput /= survival;
+        }
+    }
+
+    // If we exceed the ray bounce limit, no more light is gathered.
+    return {0, 0, 0};
 }
@@ -0,0 +1,536 @@
+#include "compressed_mesh.h"
+
+#include "morton.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <unordered_map>
+#include <utility>
+
+// Bits of the mesh grid along the longest side of the mesh, and of a cluster grid coordinate.
+static constexpr int mesh_grid_bits    = 24;
+static constexpr int cluster_grid_bits = 16;
+
+/// Octahedral encoding: folds the unit sphere onto the octahedron |x| + |y| + |z| = 1, unfolds that onto the square [-1, 1]^2 and stores
+/// the square in two snorm16 values, spreading the precision evenly over all directions.
+static void encode_normal(const vec3 &normal, int16_t *encoded)
+{
+    const double l1 = std::fabs(normal.x()) + std::fabs(normal.y()) + std::fabs(normal.z());
+    double       x  = l1 > 0 ? normal.x() / l1 : 0;
+    double       y  = l1 > 0 ? normal.y() / l1 : 0;
+    if (normal.z() < 0)
+    {
+        // Fold the lower half over the edges of the upper one.
+        const double folded_x = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        const double folded_y = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x                     = folded_x;
+        y                     = folded_y;
+    }
+    encoded[0] = static_cast<int16_t>(std::lround(std::clamp(x, -1.0, 1.0) * 32767));
+    encoded[1] = static_cast<int16_t>(std::lround(std::clamp(y, -1.0, 1.0) * 32767));
+}
+
+static vec3 decode_normal(const int16_t *encoded)
+{
+    double       x = encoded[0] / 32767.0;
+    double       y = encoded[1] / 32767.0;
+    const double z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        const double unfolded_x = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        const double unfolded_y = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x                       = unfolded_x;
+        y                       = unfolded_y;
+    }
+    return unit_vector(vec3(x, y, z));
+}
+
+compressed_mesh::compressed_mesh(const mesh_buffers &mesh, shared_ptr<material> mat, const int cluster_size)
+    : mat(std::move(mat))
+{
+    if (mesh.indices.size() % 3 != 0)
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.indices.size() << " indices, which is not a whole number of triangles.\n";
+        return;
+    }
+    if (!mesh.normals.empty() && mesh.normals.size() != mesh.positions.size())
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.normals.size() << " normals for " << mesh.positions.size() << " positions.\n";
+        return;
+    }
+    if (!mesh.uvs.empty() && mesh.uvs.size() != 2 * mesh.positions.size())
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.uvs.size() / 2 << " texture coordinates for " << mesh.positions.size() << " positions.\n";
+        return;
+    }
+    if (mesh.triangle_count() == 0) return;
+
+    // Bounds of the triangles, and of their centroids for the Morton codes.
+    aabb box       = aabb::empty;
+    aabb centroids = aabb::empty;
+    for (uint32_t triangle = 0; triangle < mesh.triangle_count(); triangle++)
+    {
+        const uint32_t *vertex = &mesh.indices[3 * triangle];
+        if (vertex[0] >= mesh.positions.size() || vertex[1] >= mesh.positions.size() || vertex[2] >= mesh.positions.size())
+        {
+            std::cerr << "ERROR: Mesh triangle " << triangle << " indexes past its " << mesh.positions.size() << " positions.\n";
+            return;
+        }
+
+        const point3 &p0 = mesh.positions[vertex[0]], &p1 = mesh.positions[vertex[1]], &p2 = mesh.positions[vertex[2]];
+        box              = aabb(box, aabb(aabb(p0, p1), aabb(p2, p2)));
+        const point3 c   = (p0 + p1 + p2) / 3;
+        centroids        = aabb(centroids, aabb(c, c));
+    }
+
+    // One grid over the whole mesh, fine enough that every cluster grid is a power-of-two multiple of it.
+    origin = point3(box.x.min, box.y.min, box.z.min);
+    step   = std::max({box.x.size(), box.y.size(), box.z.size()}) / (1 << mesh_grid_bits);
+    if (step <= 0) step = 1;
+
+    // Sort the triangles along a 63-bit Morton curve through their centroids, x taking the highest bit of every triple, then y, then z.
+    std::vector<triangle_key> keys(mesh.triangle_count()), scratch(mesh.triangle_count());
+    for (uint32_t triangle = 0; triangle < mesh.triangle_count(); triangle++)
+    {
+        const uint32_t *vertex = &mesh.indices[3 * triangle];
+        const point3    c      = (mesh.positions[vertex[0]] + mesh.positions[vertex[1]] + mesh.positions[vertex[2]]) / 3;
+        uint64_t        code   = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const interval &extent = centroids.axis_interval(axis);
+            const double    offset = extent.size() > 0 ? (c[axis] - extent.min) / extent.size() : 0.0;
+            code |= spread_bits(static_cast<uint64_t>(std::clamp(offset * (1 << 21), 0.0, (1 << 21) - 1.0))) << (2 - axis);
+        }
+        keys[triangle] = {code, triangle};
+    }
+    for (int shift = 0; shift < 63; shift += 8)
+    {
+        size_t offsets[257] = {};
+        for (const triangle_key &key : keys) { offsets[(key.code >> shift & 0xff) + 1]++; }
+        for (int digit = 0; digit < 256; digit++) { offsets[digit + 1] += offsets[digit]; }
+        for (const triangle_key &key : keys) { scratch[offsets[key.code >> shift & 0xff]++] = key; }
+        keys.swap(scratch);
+    }
+    scratch = {};
+
+    bbox = build_node(mesh, keys, std::clamp(cluster_size, 1, max_cluster_size));
+
+    const int depth = hierarchy_depth(nodes);
+    if (depth > traversal_stack_size)
+    {
+        std::cerr << "ERROR: Compressed mesh BVH of depth " << depth << " is deeper than the " << traversal_stack_size
+                  << " levels it can traverse.\n";
+        bbox = aabb::empty;
+        nodes.clear();
+        clusters.clear();
+        cluster_nodes.clear();
+        corners.clear();
+        positions.clear();
+        normals.clear();
+        uvs.clear();
+    }
+}
+
+size_t compressed_mesh::memory_bytes() const
+{
+    return sizeof(linear_bvh_node) * nodes.size() + sizeof(mesh_cluster) * clusters.size() + sizeof(cluster_node) * cluster_nodes.size()
+           + sizeof(uint16_t) * (corners.size() + positions.size() + uvs.size()) + sizeof(int16_t) * normals.size();
+}
+
+aabb compressed_mesh::build_node(const mesh_buffers &mesh, const std::span<const triangle_key> keys, const int cluster_size)
+{
+    if (keys.size() <= static_cast<size_t>(cluster_size))
+    {
+        const auto cluster = static_cast<uint32_t>(clusters.size());
+        const aabb box     = add_cluster(mesh, keys);
+        nodes.push_back({box, cluster, 1, 0, 0});
+        return box;
+    }
+
+    // As bvh_node::build_morton: every code from the first with the highest differing bit set onwards belongs on the upper side, and
+    // identical codes are split down the middle.
+    size_t mid  = keys.size() / 2;
+    int    axis = -1;
+    if (keys.front().code != keys.back().code)
+    {
+        const int split_bit = 63 - std::countl_zero(keys.front().code ^ keys.back().code);
+        const auto below    = [split_bit](const triangle_key &key) { return (key.code >> split_bit & 1) == 0; };
+        mid                 = static_cast<size_t>(std::partition_point(keys.begin(), keys.end(), below) - keys.begin());
+        axis                = 2 - split_bit % 3;
+    }
+
+    // The interior boxes are made from the decoded clusters, whose triangles moved onto the cluster grids.
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({aabb::empty, 0, 0, 0, 0});
+
+    const aabb left     = build_node(mesh, keys.first(mid), cluster_size);
+    nodes[index].offset = static_cast<uint32_t>(nodes.size());
+    const aabb right    = build_node(mesh, keys.subspan(mid), cluster_size);
+
+    nodes[index].bbox = aabb(left, right);
+    nodes[index].axis = static_cast<uint8_t>(axis < 0 ? nodes[index].bbox.longest_axis() : axis);
+    return nodes[index].bbox;
+}
+
+aabb compressed_mesh::add_cluster(const mesh_buffers &mesh, const std::span<const triangle_key> keys)
+{
+    mesh_cluster cluster{};
+    cluster.first_node     = static_cast<uint32_t>(cluster_nodes.size());
+    cluster.first_vertex   = static_cast<uint32_t>(positions.size() / 3);
+    cluster.first_triangle = static_cast<uint32_t>(corners.size() / 3);
+
+    // Give the vertices of the cluster's triangles, in Morton order, cluster-local indices.
+    std::unordered_map<uint32_t, uint16_t> local_index;
+    std::vector<uint32_t>                  vertices;
+    std::vector<cluster_triangle>          triangles(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t vertex       = mesh.indices[3 * keys[i].triangle + corner];
+            const auto [entry, fresh]   = local_index.try_emplace(vertex, static_cast<uint16_t>(vertices.size()));
+            if (fresh) vertices.push_back(vertex);
+            triangles[i].corner[corner] = entry->second;
+        }
+    }
+
+    // Place the vertices on the mesh grid, then coarsen it for the cluster until the cluster's extent fits 16 bits.
+    std::vector<int64_t> grid(3 * vertices.size());
+    int64_t              grid_min[3] = {INT64_MAX, INT64_MAX, INT64_MAX};
+    int64_t              grid_max[3] = {INT64_MIN, INT64_MIN, INT64_MIN};
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        const point3 &p = mesh.positions[vertices[v]];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            grid[3 * v + axis] = std::llround((p[axis] - origin[axis]) / step);
+            grid_min[axis]     = std::min(grid_min[axis], grid[3 * v + axis]);
+            grid_max[axis]     = std::max(grid_max[axis], grid[3 * v + axis]);
+        }
+    }
+
+    const auto fits = [&](const int shift) {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const int64_t base = grid_min[axis] >> shift << shift;
+            if ((grid_max[axis] - base + (int64_t(1) << shift >> 1)) >> shift >= int64_t(1) << cluster_grid_bits) return false;
+        }
+        return true;
+    };
+    while (!fits(cluster.shift)) cluster.shift++;
+
+    const int64_t half = int64_t(1) << cluster.shift >> 1;
+    for (int axis = 0; axis < 3; axis++) cluster.base[axis] = static_cast<int32_t>(grid_min[axis] >> cluster.shift << cluster.shift);
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            positions.push_back(static_cast<uint16_t>((grid[3 * v + axis] - cluster.base[axis] + half) >> cluster.shift));
+        }
+    }
+
+    if (!mesh.normals.empty())
+    {
+        for (const uint32_t vertex : vertices)
+        {
+            int16_t encoded[2];
+            encode_normal(mesh.normals[vertex], encoded);
+            normals.insert(normals.end(), {encoded[0], encoded[1]});
+        }
+    }
+
+    if (!mesh.uvs.empty())
+    {
+        double uv_max[2] = {-infinity, -infinity};
+        cluster.uv_min[0] = cluster.uv_min[1] = infinity;
+        for (const uint32_t vertex : vertices)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                cluster.uv_min[k] = std::min(cluster.uv_min[k], mesh.uvs[2 * vertex + k]);
+                uv_max[k]         = std::max(uv_max[k], mesh.uvs[2 * vertex + k]);
+            }
+        }
+        for (int k = 0; k < 2; k++) cluster.uv_scale[k] = (uv_max[k] - cluster.uv_min[k]) / 65535;
+
+        for (const uint32_t vertex : vertices)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                const double fraction = cluster.uv_scale[k] > 0 ? (mesh.uvs[2 * vertex + k] - cluster.uv_min[k]) / cluster.uv_scale[k] : 0;
+                uvs.push_back(static_cast<uint16_t>(std::lround(fraction)));
+            }
+        }
+    }
+
+    // Bound each triangle on the cluster grid, and build the cluster's hierarchy over those boxes.
+    const uint16_t *cluster_positions = &positions[3 * cluster.first_vertex];
+    for (cluster_triangle &triangle : triangles)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const uint16_t a     = cluster_positions[3 * triangle.corner[0] + axis];
+            const uint16_t b     = cluster_positions[3 * triangle.corner[1] + axis];
+            const uint16_t c     = cluster_positions[3 * triangle.corner[2] + axis];
+            triangle.lower[axis] = std::min({a, b, c});
+            triangle.upper[axis] = std::max({a, b, c});
+        }
+    }
+    build_cluster_node(cluster, triangles);
+
+    clusters.push_back(cluster);
+    const cluster_node &root = cluster_nodes[cluster.first_node];
+    return aabb(decode_position(cluster, root.lower), decode_position(cluster, root.upper));
+}
+
+/// @return Half the surface area of the cluster grid cells from lower to upper.
+static double grid_area(const uint16_t *lower, const uint16_t *upper)
+{
+    const double x = upper[0] - lower[0] + 1.0, y = upper[1] - lower[1] + 1.0, z = upper[2] - lower[2] + 1.0;
+    return x * y + y * z + z * x;
+}
+
+void compressed_mesh::build_cluster_node(const mesh_cluster &cluster, const std::span<cluster_triangle> triangles)
+{
+    const size_t index = cluster_nodes.size();
+    cluster_node node{{UINT16_MAX, UINT16_MAX, UINT16_MAX}, {0, 0, 0}, 0, 0, 0};
+    for (const cluster_triangle &triangle : triangles)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.lower[axis] = std::min(node.lower[axis], triangle.lower[axis]);
+            node.upper[axis] = std::max(node.upper[axis], triangle.upper[axis]);
+        }
+    }
+
+    // Costs are in units of a triangle test, scaled by the node's area: a leaf tests every triangle, and a split visits one node and then
+    // each child with the chance its area gives. Clusters are small enough to sweep every centroid boundary along every axis.
+    const size_t        count     = triangles.size();
+    const double        area      = grid_area(node.lower, node.upper);
+    double              best_cost = count <= max_leaf_size ? area * static_cast<double>(count) : infinity;
+    int                 best_axis = -1;
+    size_t              best_mid  = 0;
+    std::vector<double> right_area(count);
+    for (int axis = 0; axis < 3 && count > 1; axis++)
+    {
+        std::sort(triangles.begin(), triangles.end(), [axis](const cluster_triangle &a, const cluster_triangle &b) {
+            return a.lower[axis] + a.upper[axis] < b.lower[axis] + b.upper[axis];
+        });
+
+        uint16_t lower[3] = {UINT16_MAX, UINT16_MAX, UINT16_MAX}, upper[3] = {0, 0, 0};
+        for (size_t i = count; i-- > 1;)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                lower[k] = std::min(lower[k], triangles[i].lower[k]);
+                upper[k] = std::max(upper[k], triangles[i].upper[k]);
+            }
+            right_area[i] = grid_area(lower, upper);
+        }
+
+        std::fill(lower, lower + 3, UINT16_MAX);
+        std::fill(upper, upper + 3, 0);
+        for (size_t mid = 1; mid < count; mid++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                lower[k] = std::min(lower[k], triangles[mid - 1].lower[k]);
+                upper[k] = std::max(upper[k], triangles[mid - 1].upper[k]);
+            }
+            const double cost =
+                area + grid_area(lower, upper) * static_cast<double>(mid) + right_area[mid] * static_cast<double>(count - mid);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_mid  = mid;
+            }
+        }
+    }
+
+    if (best_axis < 0)
+    {
+        node.offset = static_cast<uint16_t>(corners.size() / 3 - cluster.first_triangle);
+        node.count  = static_cast<uint8_t>(count);
+        for (const cluster_triangle &triangle : triangles) corners.insert(corners.end(), triangle.corner, triangle.corner + 3);
+        cluster_nodes.push_back(node);
+        return;
+    }
+
+    if (best_axis != 2)
+    {
+        std::sort(triangles.begin(), triangles.end(), [best_axis](const cluster_triangle &a, const cluster_triangle &b) {
+            return a.lower[best_axis] + a.upper[best_axis] < b.lower[best_axis] + b.upper[best_axis];
+        });
+    }
+    node.axis = static_cast<uint8_t>(best_axis);
+    cluster_nodes.push_back(node);
+
+    build_cluster_node(cluster, triangles.first(best_mid));
+    cluster_nodes[index].offset = static_cast<uint16_t>(cluster_nodes.size() - cluster.first_node);
+    build_cluster_node(cluster, triangles.subspan(best_mid));
+}
+
+point3 compressed_mesh::decode_position(const mesh_cluster &cluster, const uint16_t *quantized) const
+{
+    // The sum is exact, so equal grid points decode to equal doubles in every cluster.
+    return {origin.x() + step * static_cast<double>(cluster.base[0] + (static_cast<int32_t>(quantized[0]) << cluster.shift)),
+            origin.y() + step * static_cast<double>(cluster.base[1] + (static_cast<int32_t>(quantized[1]) << cluster.shift)),
+            origin.z() + step * static_cast<double>(cluster.base[2] + (static_cast<int32_t>(quantized[2]) << cluster.shift))};
+}
+
+bool compressed_mesh::hit(const ray &r, interval ray_t, hit_record &rec) const
+{
+    if (nodes.empty()) return false;
+
+    const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+    const bool dir_is_negative[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint32_t         stack[traversal_stack_size];
+    int              stack_size      = 0;
+    uint32_t         current         = 0;
+    uint32_t         closest         = 0;
+    uint32_t         closest_cluster = 0;
+    double           closest_b1 = 0, closest_b2 = 0;
+    bool             hit_any         = false;
+    traversal_stats &stats           = thread_traversal_stats();
+
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[current];
+        stats.node_visits++;
+
+        if (node.bbox.hit(r.origin(), inv_dir, ray_t))
+        {
+            if (node.prim_count > 0)
+            {
+                uint32_t triangle;
+                double   b1, b2;
+                if (hit_cluster(clusters[node.offset], r, inv_dir, ray_t, triangle, b1, b2))
+                {
+                    hit_any         = true;
+                    closest         = triangle;
+                    closest_cluster = node.offset;
+                    closest_b1      = b1;
+                    closest_b2      = b2;
+                }
+            } else
+            {
+                assert(stack_size < traversal_stack_size);
+                if (dir_is_negative[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current             = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    current             = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+
+    if (hit_any) set_hit_record(clusters[closest_cluster], closest, r, ray_t.max, closest_b1, closest_b2, rec);
+    return hit_any;
+}
+
+bool compressed_mesh::hit_cluster(const mesh_cluster &cluster, const ray &r, const vec3 &inv_dir, interval &ray_t, uint32_t &triangle,
+                                  double &b1, double &b2) const
+{
+    const cluster_node *cluster_root      = &cluster_nodes[cluster.first_node];
+    const uint16_t     *cluster_positions = &positions[3 * cluster.first_vertex];
+    const bool          dir_is_negative[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint16_t         stack[max_cluster_size]; // A cluster has fewer interior nodes than triangles
+    int              stack_size = 0;
+    uint16_t         current    = 0;
+    bool             hit_any    = false;
+    traversal_stats &stats      = thread_traversal_stats();
+
+    while (true)
+    {
+        const cluster_node &node = cluster_root[current];
+        stats.node_visits++;
+
+        if (aabb(decode_position(cluster, node.lower), decode_position(cluster, node.upper)).hit(r.origin(), inv_dir, ray_t))
+        {
+            if (node.count > 0)
+            {
+                stats.primitive_tests += node.count;
+                for (uint32_t i = cluster.first_triangle + node.offset; i < cluster.first_triangle + node.offset + node.count; i++)
+                {
+                    const uint16_t *corner = &corners[3 * i];
+                    double          t, u, v;
+                    if (intersect_triangle(decode_position(cluster, &cluster_positions[3 * corner[0]]),
+                                           decode_position(cluster, &cluster_positions[3 * corner[1]]),
+                                           decode_position(cluster, &cluster_positions[3 * corner[2]]), r, ray_t, t, u, v))
+                    {
+                        hit_any   = true;
+                        ray_t.max = t;
+                        triangle  = i;
+                        b1        = u;
+                        b2        = v;
+                    }
+                }
+            } else
+            {
+                assert(stack_size < max_cluster_size);
+                if (dir_is_negative[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current             = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    current             = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+    return hit_any;
+}
+
+void compressed_mesh::set_hit_record(const mesh_cluster &cluster, const uint32_t triangle, const ray &r, const double t, const double b1,
+                                     const double b2, hit_record &rec) const
+{
+    const uint16_t *corner = &corners[3 * triangle];
+    const uint32_t  vertex[3] = {cluster.first_vertex + corner[0], cluster.first_vertex + corner[1], cluster.first_vertex + corner[2]};
+    const double    b0     = 1 - b1 - b2;
+
+    vec3 outward_normal;
+    if (!normals.empty())
+    {
+        outward_normal = unit_vector(b0 * decode_normal(&normals[2 * vertex[0]]) + b1 * decode_normal(&normals[2 * vertex[1]])
+                                     + b2 * decode_normal(&normals[2 * vertex[2]]));
+    } else
+    {
+        const point3 p0 = decode_position(cluster, &positions[3 * vertex[0]]);
+        outward_normal  = unit_vector(cross(decode_position(cluster, &positions[3 * vertex[1]]) - p0,
+                                           decode_position(cluster, &positions[3 * vertex[2]]) - p0));
+    }
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, outward_normal);
+
+    if (!uvs.empty())
+    {
+        const auto uv = [&](const uint32_t v, const int k) { return cluster.uv_min[k] + cluster.uv_scale[k] * uvs[2 * v + k]; };
+        rec.u         = b0 * uv(vertex[0], 0) + b1 * uv(vertex[1], 0) + b2 * uv(vertex[2], 0);
+        rec.v         = b0 * uv(vertex[0], 1) + b1 * uv(vertex[1], 1) + b2 * uv(vertex[2], 1);
+    } else
+    {
+        rec.u = b1;
+        rec.v = b2;
+    }
+    rec.mat = mat.get();
+}
@@ -0,0 +1,81 @@
+#include "framebuffer.h"
+
+#include <charconv>
+#include <string>
+
+
+framebuffer::framebuffer(const int width, const int height)
+    : image_width(width),
+      image_height(height),
+      rgb(3 * static_cast<size_t>(width) * height, 0.0f),
+      luminance_squares(static_cast<size_t>(width) * height, 0.0f),
+      samples(static_cast<size_t>(width) * height, 0) {}
+
+void framebuffer::add_samples(const int i, const int j, const color &sample_sum, const double luminance_square_sum, const int sample_count)
+{
+    const size_t pixel_index = index(i, j);
+    float *      p           = &rgb[3 * pixel_index];
+    p[0] += static_cast<float>(sample_sum.x());
+    p[1] += static_cast<float>(sample_sum.y());
+    p[2] += static_cast<float>(sample_sum.z());
+    luminance_squares[pixel_index] += static_cast<float>(luminance_square_sum);
+    samples[pixel_index] += sample_count;
+}
+
+color framebuffer::pixel(const int i, const int j) const
+{
+    const size_t pixel_index = index(i, j);
+    if (samples[pixel_index] == 0) return {0, 0, 0};
+
+    const float *p = &rgb[3 * pixel_index];
+    return color(p[0], p[1], p[2]) / samples[pixel_index];
+}
+
+double framebuffer::relative_error(const int i, const int j) const
+{
+    const size_t pixel_index = index(i, j);
+    const int    n           = samples[pixel_index];
+    if (n < 2) return infinity;
+
+    const double mean     = luminance(pixel(i, j));
+    const double variance = std::fmax(0.0, (luminance_squares[pixel_index] - n * mean * mean) / (n - 1));
+
+    return sqrt(variance / n) / std::fmax(mean, 0.01);
+}
+
+void framebuffer::write(std::ostream &out, const image_format format) const
+{
+    const bool        binary = format == image_format::ppm_binary;
+    const size_t      pixels = static_cast<size_t>(image_width) * image_height;
+    const std::string header = (binary ? "P6\n" : "P3\n") + std::to_string(image_width) + ' ' + std::to_string(image_height) + "\n255\n";
+
+    // Binary pixels take exactly 3 bytes; ASCII pixels take at most 12 ("255 255 255\n").
+    std::string buffer(header.size() + pixels * (binary ? 3 : 12), '\0');
+    char *      cursor = buffer.data() + header.copy(buffer.data(), header.size());
+
+    for (int j = 0; j < image_height; j++)
+    {
+        for (int i = 0; i < image_width; i++)
+        {
+            unsigned char bytes[3];
+            color_to_bytes(pixel(i, j), bytes);
+
+            if (binary)
+            {
+                *cursor++ = static_cast<char>(bytes[0]);
+                *cursor++ = static_cast<char>(bytes[1]);
+                *cursor++ = static_cast<char>(bytes[2]);
+                continue;
+            }
+
+            for (int channel = 0; channel < 3; channel++)
+            {
+                cursor    = std::to_chars(cursor, cursor + 3, bytes[channel]).ptr;
+                *cursor++ = channel < 2 ? ' ' : '\n';
+            }
+        }
+    }
+
+    out.write(buffer.data(), cursor - buffer.data());
+    out.flush();
+}
@@ -0,0 +1,179 @@
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+
+linear_bvh::linear_bvh(const hittable_list &list, const bvh_build_options &options)
+    : linear_bvh(bvh_node(list, options)) {}
+
+linear_bvh::linear_bvh(const bvh_node &root)
+{
+    // An empty scene's lone leaf would read as an interior node, so leave the array empty instead.
+    if (!root.is_leaf() || !root.leaf_objects().empty()) flatten(root);
+    nodes = node_storage;
+    check_depth();
+}
+
+linear_bvh::linear_bvh(shared_ptr<const mapped_file> mapping, const std::span<const linear_bvh_node> mapped_nodes,
+                       std::vector<shared_ptr<hittable> > primitives)
+    : mapping(std::move(mapping)),
+      nodes(mapped_nodes),
+      primitives(std::move(primitives))
+{
+    check_depth();
+}
+
+int hierarchy_depth(const std::span<const linear_bvh_node> nodes)
+{
+    // Children follow their parent, so a forward pass reaches every node after the depths of its parents are known. A valid tree gives each
+    // node one parent, but taking the deepest keeps the count safe for any array whose children only point forward.
+    std::vector<int> depth(nodes.size(), 0);
+    int              deepest = 0;
+    for (size_t index = 0; index < nodes.size(); index++)
+    {
+        if (nodes[index].prim_count > 0) continue;
+
+        const int child_depth = depth[index] + 1;
+        deepest               = std::max(deepest, child_depth);
+        if (index + 1 < nodes.size()) depth[index + 1] = std::max(depth[index + 1], child_depth);
+        if (nodes[index].offset < nodes.size()) depth[nodes[index].offset] = std::max(depth[nodes[index].offset], child_depth);
+    }
+    return deepest;
+}
+
+void linear_bvh::check_depth()
+{
+    const int depth = hierarchy_depth(nodes);
+    if (depth <= traversal_stack_size) return;
+
+    std::cerr << "ERROR: BVH of depth " << depth << " is deeper than the " << traversal_stack_size << " levels linear_bvh can traverse.\n";
+    node_storage.clear();
+    nodes = {};
+    mapping.reset();
+    primitives.clear();
+}
+
+uint32_t linear_bvh::flatten(const bvh_node &node)
+{
+    if (node.is_leaf()) return add_leaf(node.bbox, node.objects);
+
+    const auto index = static_cast<uint32_t>(node_storage.size());
+    node_storage.push_back({node.bbox, 0, 0, static_cast<uint8_t>(node.axis), 0});
+
+    flatten(*node.left);
+    node_storage[index].offset = flatten(*node.right);
+    return index;
+}
+
+uint32_t linear_bvh::add_leaf(const aabb &bbox, const std::vector<shared_ptr<hittable> > &leaf_primitives)
+{
+    const auto index = static_cast<uint32_t>(node_storage.size());
+    node_storage.push_back({bbox, static_cast<uint32_t>(primitives.size()), static_cast<uint16_t>(leaf_primitives.size()), 0, 0});
+    primitives.insert(primitives.end(), leaf_primitives.begin(), leaf_primitives.end());
+    return index;
+}
+
+bool linear_bvh::hit(const ray &r, interval ray_t, hit_record &rec) const
+{
+    if (nodes.empty()) return false;
+
+    const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+    const bool dir_is_negative[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint32_t         stack[traversal_stack_size];
+    int              stack_size   = 0;
+    uint32_t         current      = 0;
+    bool             hit_anything = false;
+    traversal_stats &stats        = thread_traversal_stats();
+
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[current];
+        stats.node_visits++;
+
+        if (node.bbox.hit(r.origin(), inv_dir, ray_t))
+        {
+            if (node.prim_count > 0)
+            {
+                stats.primitive_tests += node.prim_count;
+                for (uint32_t i = node.offset; i < node.offset + node.prim_count; i++)
+                {
+                    if (primitives[i]->hit(r, ray_t, rec))
+                    {
+                        hit_anything = true;
+                        ray_t.max    = rec.t;
+                    }
+                }
+            } else
+            {
+                // Visit the near child first and save the far child for later.
+                assert(stack_size < traversal_stack_size);
+                if (dir_is_negative[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current             = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    current             = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+void linear_bvh::hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const
+{
+    if (nodes.empty()) return;
+
+    struct entry
+    {
+        uint32_t node;
+        uint32_t lanes;
+    };
+
+    entry            stack[traversal_stack_size];
+    int              stack_size = 0;
+    entry            current    = {0, lane_mask};
+    traversal_stats &stats      = thread_traversal_stats();
+
+    while (true)
+    {
+        const linear_bvh_node &node  = nodes[current.node];
+        const uint32_t         lanes = node.bbox.hit_packet(rays, t_min, hits.t_max, current.lanes);
+        stats.node_visits += std::popcount(current.lanes);
+
+        if (lanes != 0)
+        {
+            if (node.prim_count > 0)
+            {
+                stats.primitive_tests += static_cast<uint64_t>(std::popcount(lanes)) * node.prim_count;
+                for (uint32_t i = node.offset; i < node.offset + node.prim_count; i++) { primitives[i]->hit_packet(rays, t_min, lanes, hits); }
+            } else
+            {
+                // Coherent rays share direction signs, so order the children by the first active lane.
+                const int  first_lane = std::countr_zero(lanes);
+                const bool negative   = rays.inv_direction[node.axis][first_lane] < 0;
+
+                assert(stack_size < traversal_stack_size);
+                stack[stack_size++] = {negative ? current.node + 1 : node.offset, lanes};
+                current             = {negative ? node.offset : current.node + 1, lanes};
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+}
+
+aabb linear_bvh::bounding_box() const { return nodes.empty() ? aabb::empty : nodes[0].bbox; }
@@ -0,0 +1,66 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(_WIN32)
+mapped_file::mapped_file(const std::string &path)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) return;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr) return;
+
+    bytes  = static_cast<const unsigned char *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    length = bytes != nullptr ? static_cast<size_t>(file_size.QuadPart) : 0;
+}
+
+mapped_file::~mapped_file()
+{
+    if (bytes != nullptr) UnmapViewOfFile(bytes);
+    if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+    if (file_handle != nullptr) CloseHandle(file_handle);
+}
+#else
+mapped_file::mapped_file(const std::string &path)
+{
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return;
+
+    // The mapping keeps the file alive, so the descriptor can be closed as soon as it is made.
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping != MAP_FAILED)
+        {
+            bytes  = static_cast<const unsigned char *>(mapping);
+            length = static_cast<size_t>(status.st_size);
+        }
+    }
+
+    close(file);
+}
+
+mapped_file::~mapped_file()
+{
+    if (bytes != nullptr) munmap(const_cast<unsigned char *>(bytes), length);
+}
+#endif
@@ -5,6 +5,8 @@
 
 bool material::scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const { return false; }
 
+material_type material::type() const { return material_type::other; }
+
 lambertian::lambertian(const color &albedo) : tex(make_shared<solid_color_texture>(albedo)) {}
 
 lambertian::lambertian(const shared_ptr<texture> &tex) : tex(tex) {}
@@ -22,6 +24,8 @@ bool lambertian::scatter(const ray &r_in, const hit_record &rec, color &attenuat
     return true;
 }
 
+material_type lambertian::type() const { return material_type::lambertian; }
+
 metal::metal(const color &albedo, const double fuzz)
     : albedo(albedo),
       fuzz(fuzz < 1 ? fuzz : 1) {}
@@ -36,6 +40,8 @@ bool metal::scatter(const ray &r_in, const hit_record &rec, color &attenuation,
     return (dot(scattered.direction(), rec.normal) > 0);
 }
 
+material_type metal::type() const { return material_type::metal; }
+
 dielectric::dielectric(const double refraction_index) : refraction_index(refraction_index) {}
 
 bool dielectric::scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const
@@ -58,6 +64,8 @@ bool dielectric::scatter(const ray &r_in, const hit_record &rec, color &attenuat
     return true;
 }
 
+material_type dielectric::type() const { return material_type::dielectric; }
+
 double dielectric::reflectance(const double cosine, const double refraction_index)
 {
     // Use Schlick's approximation for reflectance.
@@ -0,0 +1,730 @@
+#include "mesh_loader.h"
+
+#include "mapped_file.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+
+/// Marks an attribute a corner doesn't reference.
+static constexpr uint32_t no_index = ~uint32_t(0);
+
+/// @return How many chunks to parse a file of size bytes in: a few per thread, but none smaller than a megabyte.
+static size_t parse_chunk_count(const size_t size, const int threads)
+{
+    if (threads < 2) return 1;
+    return std::clamp<size_t>(size >> 20, 1, static_cast<size_t>(threads) * 8);
+}
+
+static void skip_spaces(const char *&p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+}
+
+static void skip_line(const char *&p, const char *end)
+{
+    const void *newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    p                   = newline ? static_cast<const char *>(newline) + 1 : end;
+}
+
+static bool at_line_end(const char *p, const char *end) { return p == end || *p == '\n' || *p == '\r' || *p == '#'; }
+
+static bool parse_number(const char *&p, const char *end, double &value)
+{
+    skip_spaces(p, end);
+    if (p < end && *p == '+') p++;
+
+    const auto [next, error] = std::from_chars(p, end, value);
+    if (error != std::errc()) return false;
+    p = next;
+    return true;
+}
+
+static bool parse_number(const char *&p, const char *end, long long &value)
+{
+    if (p < end && *p == '+') p++;
+
+    const auto [next, error] = std::from_chars(p, end, value);
+    if (error != std::errc()) return false;
+    p = next;
+    return true;
+}
+
+// --- OBJ ---
+
+enum class obj_line
+{
+    other,
+    position,
+    uv,
+    normal,
+    face,
+};
+
+/// Reads the keyword at the start of a line, leaving p just past it.
+static obj_line read_keyword(const char *&p, const char *end)
+{
+    skip_spaces(p, end);
+
+    const char *word = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+
+    const std::string_view keyword(word, static_cast<size_t>(p - word));
+    if (keyword == "v") return obj_line::position;
+    if (keyword == "vt") return obj_line::uv;
+    if (keyword == "vn") return obj_line::normal;
+    if (keyword == "f") return obj_line::face;
+    return obj_line::other;
+}
+
+/// What one chunk of an OBJ file holds, and where in the whole file's arrays its entries start.
+struct obj_chunk
+{
+    const char *begin, *end;
+
+    size_t positions = 0, uvs = 0, normals = 0;
+    size_t corners   = 0; // Three per triangle, after splitting polygons into fans
+    bool   failed    = false;
+};
+
+/// One corner of a triangle, as 0-based indices into the file's positions, texture coordinates and normals.
+struct obj_corner
+{
+    uint32_t position, uv, normal;
+};
+
+/// @return The 0-based index an OBJ index refers to: counting from 1, or back from the last of the seen entries before it if negative.
+static uint32_t resolve_obj_index(const long long index, const size_t seen)
+{
+    if (index > 0 && static_cast<unsigned long long>(index) <= seen) return static_cast<uint32_t>(index - 1);
+    if (index < 0 && static_cast<unsigned long long>(-index) <= seen) return static_cast<uint32_t>(static_cast<long long>(seen) + index);
+    return no_index;
+}
+
+static void count_obj_chunk(obj_chunk &chunk)
+{
+    for (const char *p = chunk.begin; p < chunk.end; skip_line(p, chunk.end))
+    {
+        switch (read_keyword(p, chunk.end))
+        {
+            case obj_line::position: chunk.positions++;
+                break;
+            case obj_line::uv: chunk.uvs++;
+                break;
+            case obj_line::normal: chunk.normals++;
+                break;
+            case obj_line::face:
+            {
+                size_t corners = 0;
+                while (true)
+                {
+                    skip_spaces(p, chunk.end);
+                    if (at_line_end(p, chunk.end)) break;
+                    while (p < chunk.end && *p != ' ' && *p != '\t' && !at_line_end(p, chunk.end)) p++;
+                    corners++;
+                }
+                if (corners >= 3) chunk.corners += 3 * (corners - 2);
+                break;
+            }
+            case obj_line::other: break;
+        }
+    }
+}
+
+/// Parses a chunk into the slices of the arrays that its counts and those of the chunks before it (in seen) set aside for it.
+static void parse_obj_chunk(obj_chunk &chunk, const obj_chunk &seen, mesh_buffers &mesh, std::vector<vec3> &uvs, std::vector<vec3> &normals,
+                            std::vector<obj_corner> &corners)
+{
+    size_t positions = seen.positions, uv_count = seen.uvs, normal_count = seen.normals, corner_count = seen.corners;
+
+    for (const char *p = chunk.begin; p < chunk.end && !chunk.failed; skip_line(p, chunk.end))
+    {
+        const obj_line line = read_keyword(p, chunk.end);
+        if (line == obj_line::other) continue;
+
+        if (line != obj_line::face)
+        {
+            // Texture coordinates may leave out v, which is then 0.
+            double    xyz[3] = {0, 0, 0};
+            const int needed = (line == obj_line::uv) ? 1 : 3;
+            for (int axis = 0; axis < needed; axis++) chunk.failed |= !parse_number(p, chunk.end, xyz[axis]);
+            if (line == obj_line::uv)
+            {
+                skip_spaces(p, chunk.end);
+                if (!at_line_end(p, chunk.end)) chunk.failed |= !parse_number(p, chunk.end, xyz[1]);
+            }
+
+            const vec3 value(xyz[0], xyz[1], xyz[2]);
+            if (line == obj_line::position) mesh.positions[positions++] = value;
+            else if (line == obj_line::uv) uvs[uv_count++] = value;
+            else normals[normal_count++] = value;
+            continue;
+        }
+
+        obj_corner first{}, previous{};
+        for (size_t corner = 0;; corner++)
+        {
+            skip_spaces(p, chunk.end);
+            if (at_line_end(p, chunk.end)) break;
+
+            // A corner is v, v/vt, v//vn or v/vt/vn.
+            long long  index   = 0;
+            obj_corner current = {no_index, no_index, no_index};
+            if (!parse_number(p, chunk.end, index)) break;
+            current.position = resolve_obj_index(index, positions);
+
+            if (p < chunk.end && *p == '/')
+            {
+                p++;
+                if (p < chunk.end && *p != '/')
+                {
+                    if (!parse_number(p, chunk.end, index)) break;
+                    current.uv = resolve_obj_index(index, uv_count);
+                }
+                if (p < chunk.end && *p == '/')
+                {
+                    p++;
+                    if (!parse_number(p, chunk.end, index)) break;
+                    current.normal = resolve_obj_index(index, normal_count);
+                }
+            }
+
+            // The count pass split corners only at spaces and tabs, so a corner that ends anywhere else, as in "1-2-3", would fill more
+            // than the slice set aside for the chunk.
+            if (current.position == no_index || (p < chunk.end && *p != ' ' && *p != '\t' && !at_line_end(p, chunk.end)))
+            {
+                chunk.failed = true;
+                break;
+            }
+
+            if (corner == 0) first = current;
+            if (corner >= 2)
+            {
+                assert(corner_count + 3 <= seen.corners + chunk.corners);
+                if (corner_count + 3 > seen.corners + chunk.corners)
+                {
+                    chunk.failed = true;
+                    break;
+                }
+                corners[corner_count++] = first;
+                corners[corner_count++] = previous;
+                corners[corner_count++] = current;
+            }
+            previous = current;
+        }
+
+        // Anything left on the line is a corner that didn't parse.
+        skip_spaces(p, chunk.end);
+        chunk.failed |= !at_line_end(p, chunk.end);
+    }
+}
+
+/// Turns the corners into the mesh's vertices and indices. Where every corner uses only positions, the positions are the vertices.
+/// Otherwise a vertex is made for every distinct combination of position, texture coordinates and normal, chaining the vertices that
+/// share a position so that each corner looks only at those.
+static void build_obj_vertices(mesh_buffers &mesh, const std::vector<vec3> &uvs, const std::vector<vec3> &normals,
+                               const std::vector<obj_corner> &corners)
+{
+    mesh.indices.resize(corners.size());
+
+    const bool has_uvs     = std::any_of(corners.begin(), corners.end(), [](const obj_corner &c) { return c.uv != no_index; });
+    const bool has_normals = std::any_of(corners.begin(), corners.end(), [](const obj_corner &c) { return c.normal != no_index; });
+    if (!has_uvs && !has_normals)
+    {
+        for (size_t corner = 0; corner < corners.size(); corner++) mesh.indices[corner] = corners[corner].position;
+        return;
+    }
+
+    const std::vector<point3> positions = std::move(mesh.positions);
+    mesh.positions.clear();
+
+    std::vector<uint32_t> vertex_of_position(positions.size(), no_index);
+    std::vector<uint32_t> next_sharing; // The next vertex with the same position, per vertex
+    std::vector<uint32_t> vertex_uv, vertex_normal;
+
+    for (size_t corner = 0; corner < corners.size(); corner++)
+    {
+        const obj_corner &c = corners[corner];
+
+        uint32_t vertex = vertex_of_position[c.position];
+        while (vertex != no_index && (vertex_uv[vertex] != c.uv || vertex_normal[vertex] != c.normal)) vertex = next_sharing[vertex];
+
+        if (vertex == no_index)
+        {
+            vertex = static_cast<uint32_t>(mesh.positions.size());
+            mesh.positions.push_back(positions[c.position]);
+            vertex_uv.push_back(c.uv);
+            vertex_normal.push_back(c.normal);
+            next_sharing.push_back(vertex_of_position[c.position]);
+            vertex_of_position[c.position] = vertex;
+        }
+        mesh.indices[corner] = vertex;
+    }
+
+    // Corners without texture coordinates or a normal get zeros, which leaves them flat shaded.
+    if (has_uvs)
+    {
+        mesh.uvs.resize(2 * mesh.positions.size(), 0.0);
+        for (size_t vertex = 0; vertex < mesh.positions.size(); vertex++)
+        {
+            if (vertex_uv[vertex] == no_index) continue;
+            mesh.uvs[2 * vertex]     = uvs[vertex_uv[vertex]].x();
+            mesh.uvs[2 * vertex + 1] = uvs[vertex_uv[vertex]].y();
+        }
+    }
+    if (has_normals)
+    {
+        mesh.normals.resize(mesh.positions.size(), vec3(0, 0, 0));
+        for (size_t vertex = 0; vertex < mesh.positions.size(); vertex++)
+        {
+            if (vertex_normal[vertex] != no_index) mesh.normals[vertex] = normals[vertex_normal[vertex]];
+        }
+    }
+}
+
+shared_ptr<mesh_buffers> load_obj(const std::string &path, const int thread_count)
+{
+    const mapped_file file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: Could not map OBJ file " << path << ".\n";
+        return nullptr;
+    }
+
+    const int   threads = worker_count(thread_count);
+    const auto *text    = reinterpret_cast<const char *>(file.data());
+    const char *end     = text + file.size();
+
+    // Cut the file into chunks that each start at the beginning of a line.
+    const size_t           chunk_count = parse_chunk_count(file.size(), threads);
+    std::vector<obj_chunk> chunks(chunk_count);
+    for (size_t chunk = 0; chunk < chunk_count; chunk++)
+    {
+        const char *begin = text + file.size() * chunk / chunk_count;
+        if (chunk > 0 && begin[-1] != '\n') skip_line(begin, end);
+        chunks[chunk].begin = begin;
+        if (chunk > 0) chunks[chunk - 1].end = std::max(chunks[chunk - 1].begin, begin);
+    }
+    chunks.back().end = end;
+
+    parallel_for(chunk_count, threads, [&](const size_t chunk) { count_obj_chunk(chunks[chunk]); });
+
+    // Each chunk writes after everything the chunks before it hold.
+    std::vector<obj_chunk> seen(chunk_count + 1, obj_chunk{});
+    for (size_t chunk = 0; chunk < chunk_count; chunk++)
+    {
+        seen[chunk + 1].positions = seen[chunk].positions + chunks[chunk].positions;
+        seen[chunk + 1].uvs       = seen[chunk].uvs + chunks[chunk].uvs;
+        seen[chunk + 1].normals   = seen[chunk].normals + chunks[chunk].normals;
+        seen[chunk + 1].corners   = seen[chunk].corners + chunks[chunk].corners;
+    }
+
+    const obj_chunk &total = seen.back();
+    if (total.positions >= no_index)
+    {
+        std::cerr << "ERROR: OBJ file " << path << " has more vertices than 32-bit indices can address.\n";
+        return nullptr;
+    }
+
+    auto                    mesh = make_shared<mesh_buffers>();
+    std::vector<vec3>       uvs(total.uvs), normals(total.normals);
+    std::vector<obj_corner> corners(total.corners);
+    mesh->positions.resize(total.positions);
+
+    parallel_for(chunk_count, threads, [&](const size_t chunk) { parse_obj_chunk(chunks[chunk], seen[chunk], *mesh, uvs, normals, corners); });
+
+    if (std::any_of(chunks.begin(), chunks.end(), [](const obj_chunk &chunk) { return chunk.failed; }))
+    {
+        std::cerr << "ERROR: OBJ file " << path << " has a malformed vertex or face.\n";
+        return nullptr;
+    }
+
+    build_obj_vertices(*mesh, uvs, normals, corners);
+    return mesh;
+}
+
+// --- PLY ---
+
+enum class ply_type
+{
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    float32,
+    float64,
+    invalid,
+};
+
+static ply_type parse_ply_type(const std::string_view name)
+{
+    if (name == "char" || name == "int8") return ply_type::int8;
+    if (name == "uchar" || name == "uint8") return ply_type::uint8;
+    if (name == "short" || name == "int16") return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32") return ply_type::int32;
+    if (name == "uint" || name == "uint32") return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    return ply_type::invalid;
+}
+
+static size_t ply_type_size(const ply_type type)
+{
+    switch (type)
+    {
+        case ply_type::int8:
+        case ply_type::uint8: return 1;
+        case ply_type::int16:
+        case ply_type::uint16: return 2;
+        case ply_type::int32:
+        case ply_type::uint32:
+        case ply_type::float32: return 4;
+        case ply_type::float64: return 8;
+        case ply_type::invalid: break;
+    }
+    return 0;
+}
+
+template<typename T>
+static T read_ply_raw(const unsigned char *bytes, const bool swap)
+{
+    unsigned char copy[sizeof(T)];
+    std::memcpy(copy, bytes, sizeof(T));
+    if (swap) std::reverse(copy, copy + sizeof(T));
+    return std::bit_cast<T>(copy);
+}
+
+/// @return The value of the given type at bytes, byte swapped first if the file's byte order isn't the machine's.
+static double read_ply_value(const unsigned char *bytes, const ply_type type, const bool swap)
+{
+    switch (type)
+    {
+        case ply_type::int8: return read_ply_raw<int8_t>(bytes, swap);
+        case ply_type::uint8: return read_ply_raw<uint8_t>(bytes, swap);
+        case ply_type::int16: return read_ply_raw<int16_t>(bytes, swap);
+        case ply_type::uint16: return read_ply_raw<uint16_t>(bytes, swap);
+        case ply_type::int32: return read_ply_raw<int32_t>(bytes, swap);
+        case ply_type::uint32: return read_ply_raw<uint32_t>(bytes, swap);
+        case ply_type::float32: return read_ply_raw<float>(bytes, swap);
+        case ply_type::float64: return read_ply_raw<double>(bytes, swap);
+        case ply_type::invalid: break;
+    }
+    return 0;
+}
+
+struct ply_property
+{
+    std::string name;
+    ply_type    type;
+    ply_type    count_type = ply_type::invalid; // For lists, the type of the entry count that precedes the entries
+    size_t      offset     = 0;                 // Byte offset in the element's record, for the properties before any list
+};
+
+struct ply_element
+{
+    std::string               name;
+    size_t                    count = 0;
+    std::vector<ply_property> properties;
+    bool                      has_list = false;
+    size_t                    size     = 0; // Bytes in one record, if it has no list
+
+    const ply_property *find(const std::initializer_list<std::string_view> names) const
+    {
+        for (const auto &property : properties)
+        {
+            for (const auto name : names)
+            {
+                if (property.name == name) return &property;
+            }
+        }
+        return nullptr;
+    }
+};
+
+/// Reads the header of a PLY file, up to and including its end_header line.
+/// @return The offset of the first data byte, or 0 if the header is malformed or the format isn't binary.
+static size_t parse_ply_header(const mapped_file &file, std::vector<ply_element> &elements, bool &big_endian)
+{
+    const auto *text = reinterpret_cast<const char *>(file.data());
+    const char *end  = text + file.size();
+    const char *p    = text;
+
+    const auto read_word = [&](const char *&q) {
+        skip_spaces(q, end);
+        const char *word = q;
+        while (q < end && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r') q++;
+        return std::string_view(word, static_cast<size_t>(q - word));
+    };
+
+    if (read_word(p) != "ply") return 0;
+    skip_line(p, end);
+
+    bool has_format = false;
+    while (p < end)
+    {
+        const char *line = p;
+        skip_line(p, end);
+
+        const auto keyword = read_word(line);
+        if (keyword == "end_header") return has_format ? static_cast<size_t>(p - text) : 0;
+        if (keyword == "format")
+        {
+            const auto format = read_word(line);
+            if (format != "binary_little_endian" && format != "binary_big_endian") return 0;
+            big_endian = format == "binary_big_endian";
+            has_format = true;
+        } else if (keyword == "element")
+        {
+            ply_element element;
+            element.name             = std::string(read_word(line));
+            const auto count         = read_word(line);
+            const auto [last, error] = std::from_chars(count.data(), count.data() + count.size(), element.count);
+            if (error != std::errc()) return 0;
+            elements.push_back(std::move(element));
+        } else if (keyword == "property")
+        {
+            if (elements.empty()) return 0;
+
+            ply_element &element = elements.back();
+            ply_property property;
+            const auto   type = read_word(line);
+            if (type == "list")
+            {
+                property.count_type = parse_ply_type(read_word(line));
+                property.type       = parse_ply_type(read_word(line));
+                if (property.count_type == ply_type::invalid) return 0;
+                element.has_list = true;
+            } else
+            {
+                property.type   = parse_ply_type(type);
+                property.offset = element.size;
+                if (!element.has_list) element.size += ply_type_size(property.type);
+            }
+            if (property.type == ply_type::invalid) return 0;
+
+            property.name = std::string(read_word(line));
+            element.properties.push_back(std::move(property));
+        }
+    }
+    return 0;
+}
+
+/// @return True if count records of size bytes each fit in available bytes, checked without multiplying so a huge count can't overflow.
+static bool records_fit(const size_t count, const size_t size, const size_t available) { return size == 0 || count <= available / size; }
+
+/// Decodes the vertex records at data into positions, normals and texture coordinates, in parallel chunks.
+static bool read_ply_vertices(const ply_element &element, const unsigned char *data, const bool swap, mesh_buffers &mesh, const int threads)
+{
+    const ply_property *x  = element.find({"x"});
+    const ply_property *y  = element.find({"y"});
+    const ply_property *z  = element.find({"z"});
+    const ply_property *nx = element.find({"nx"});
+    const ply_property *ny = element.find({"ny"});
+    const ply_property *nz = element.find({"nz"});
+    const ply_property *u  = element.find({"u", "s", "texture_u"});
+    const ply_property *v  = element.find({"v", "t", "texture_v"});
+    if (element.has_list || !x || !y || !z) return false;
+
+    const bool has_normals = nx && ny && nz;
+    const bool has_uvs     = u && v;
+
+    mesh.positions.resize(element.count);
+    if (has_normals) mesh.normals.resize(element.count);
+    if (has_uvs) mesh.uvs.resize(2 * element.count);
+
+    const size_t chunks = parse_chunk_count(element.count * element.size, threads);
+    parallel_for(chunks, threads, [&](const size_t chunk)
+    {
+        for (size_t vertex = element.count * chunk / chunks; vertex < element.count * (chunk + 1) / chunks; vertex++)
+        {
+            const unsigned char *record = data + vertex * element.size;
+
+            mesh.positions[vertex] = point3(read_ply_value(record + x->offset, x->type, swap), read_ply_value(record + y->offset, y->type, swap),
+                                            read_ply_value(record + z->offset, z->type, swap));
+            if (has_normals)
+            {
+                mesh.normals[vertex] = vec3(read_ply_value(record + nx->offset, nx->type, swap), read_ply_value(record + ny->offset, ny->type, swap),
+                                            read_ply_value(record + nz->offset, nz->type, swap));
+            }
+            if (has_uvs)
+            {
+                mesh.uvs[2 * vertex]     = read_ply_value(record + u->offset, u->type, swap);
+                mesh.uvs[2 * vertex + 1] = read_ply_value(record + v->offset, v->type, swap);
+            }
+        }
+    });
+    return true;
+}
+
+/// Decodes the face records starting at data, which end no later than end, into triangle indices.
+/// @return The number of bytes the faces take, or 0 if they are malformed.
+static size_t read_ply_faces(const ply_element &element, const unsigned char *data, const unsigned char *end, const bool swap,
+                             const size_t vertex_count, mesh_buffers &mesh, const int threads)
+{
+    // The index list must be the last property, so that the fixed-size properties before it have known offsets.
+    const ply_property *list = element.find({"vertex_indices", "vertex_index"});
+    if (list == nullptr || list->count_type == ply_type::invalid || &element.properties.back() != list) return 0;
+
+    const size_t count_size = ply_type_size(list->count_type);
+    const size_t index_size = ply_type_size(list->type);
+    const size_t list_start = element.size;
+
+    const auto read_index = [&](const unsigned char *bytes, uint32_t &index) {
+        const double value = read_ply_value(bytes, list->type, swap);
+        index              = static_cast<uint32_t>(value);
+        return value >= 0 && value < static_cast<double>(vertex_count);
+    };
+
+    // Most meshes are all triangles, and then every record has the same size and lands at a known offset. Decode on that assumption, and
+    // check every entry count as it goes.
+    const size_t triangle_size = list_start + count_size + 3 * index_size;
+    if (records_fit(element.count, triangle_size, static_cast<size_t>(end - data)))
+    {
+        mesh.indices.resize(3 * element.count);
+
+        std::atomic<bool> all_triangles(true), in_range(true);
+        const size_t      chunks = parse_chunk_count(element.count * triangle_size, threads);
+        parallel_for(chunks, threads, [&](const size_t chunk)
+        {
+            for (size_t face = element.count * chunk / chunks; face < element.count * (chunk + 1) / chunks; face++)
+            {
+                const unsigned char *record = data + face * triangle_size + list_start;
+                if (read_ply_value(record, list->count_type, swap) != 3)
+                {
+                    all_triangles = false;
+                    return;
+                }
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    if (!read_index(record + count_size + corner * index_size, mesh.indices[3 * face + corner])) in_range = false;
+                }
+            }
+        });
+
+        if (all_triangles) return in_range ? element.count * triangle_size : 0;
+    }
+
+    // Some faces aren't triangles: walk the records in order and split each polygon into a fan.
+    mesh.indices.clear();
+    const unsigned char *record = data;
+    for (size_t face = 0; face < element.count; face++)
+    {
+        if (list_start + count_size > static_cast<size_t>(end - record)) return 0;
+
+        const double count = read_ply_value(record + list_start, list->count_type, swap);
+        const auto  *first = record + list_start + count_size;
+        if (count < 0 || !records_fit(static_cast<size_t>(count), index_size, static_cast<size_t>(end - first))) return 0;
+
+        const auto corners = static_cast<size_t>(count);
+
+        uint32_t fan_center = 0, previous = 0, current = 0;
+        for (size_t corner = 0; corner < corners; corner++)
+        {
+            if (!read_index(first + corner * index_size, current)) return 0;
+            if (corner == 0) fan_center = current;
+            if (corner >= 2) mesh.indices.insert(mesh.indices.end(), {fan_center, previous, current});
+            previous = current;
+        }
+        record = first + corners * index_size;
+    }
+    return static_cast<size_t>(record - data);
+}
+
+shared_ptr<mesh_buffers> load_ply(const std::string &path, const int thread_count)
+{
+    const mapped_file file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: Could not map PLY file " << path << ".\n";
+        return nullptr;
+    }
+
+    std::vector<ply_element> elements;
+    bool                     big_endian = false;
+    const size_t             data_start = parse_ply_header(file, elements, big_endian);
+    if (data_start == 0)
+    {
+        std::cerr << "ERROR: " << path << " is not a binary PLY file.\n";
+        return nullptr;
+    }
+
+    const int            threads = worker_count(thread_count);
+    const bool           swap    = big_endian != (std::endian::native == std::endian::big);
+    const unsigned char *end     = file.data() + file.size();
+    const unsigned char *data    = file.data() + data_start;
+
+    auto   mesh         = make_shared<mesh_buffers>();
+    size_t vertex_count = 0;
+    bool   has_vertices = false, has_faces = false;
+
+    for (const auto &element : elements)
+    {
+        // Fixed-size elements are skipped over whole; faces need decoding to find where they end.
+        size_t bytes = 0;
+        if (element.name == "vertex" && !has_vertices)
+        {
+            const bool fits = records_fit(element.count, element.size, static_cast<size_t>(end - data));
+            bytes           = fits && read_ply_vertices(element, data, swap, *mesh, threads) ? element.count * element.size : 0;
+            vertex_count = element.count;
+            has_vertices = bytes > 0 || element.count == 0;
+        } else if (element.name == "face" && has_vertices && !has_faces)
+        {
+            bytes     = read_ply_faces(element, data, end, swap, vertex_count, *mesh, threads);
+            has_faces = bytes > 0 || element.count == 0;
+        } else if (!element.has_list && records_fit(element.count, element.size, static_cast<size_t>(end - data)))
+        {
+            bytes = element.count * element.size;
+        }
+
+        if (bytes == 0 && element.count > 0)
+        {
+            std::cerr << "ERROR: PLY file " << path << " has a malformed or unsupported " << element.name << " element.\n";
+            return nullptr;
+        }
+        data += bytes;
+    }
+
+    if (!has_vertices || vertex_count >= no_index)
+    {
+        std::cerr << "ERROR: PLY file " << path << " has no usable vertices.\n";
+        return nullptr;
+    }
+    return mesh;
+}
+
+shared_ptr<mesh_buffers> load_mesh(const std::string &path, const int thread_count)
+{
+    std::string extension = path.substr(std::min(path.rfind('.'), path.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    const auto start = std::chrono::steady_clock::now();
+
+    shared_ptr<mesh_buffers> mesh;
+    if (extension == ".obj") { mesh = load_obj(path, thread_count); }
+    else if (extension == ".ply") { mesh = load_ply(path, thread_count); }
+    else
+    {
+        std::cerr << "ERROR: Unknown mesh format " << path << "; expected .obj or .ply.\n";
+        return nullptr;
+    }
+    if (mesh == nullptr) return nullptr;
+
+    const double seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double megabytes = static_cast<double>(std::filesystem::file_size(path)) / (1 << 20);
+
+    std::clog << "Loaded " << path << ": " << mesh->positions.size() << " vertices and " << mesh->triangle_count() << " triangles, " << megabytes
+              << " MB in " << seconds << " seconds (" << megabytes / seconds << " MB/s on " << worker_count(thread_count) << " threads).\n";
+    return mesh;
+}
@@ -0,0 +1,149 @@
+#include "sphere_batch.h"
+
+#include "bvh.h"
+#include "simd.h"
+
+#include <algorithm>
+
+
+sphere_batch::sphere_batch(const sphere *const *spheres, const int count)
+    : count(std::clamp(count, 0, max_size))
+{
+    for (int lane = 0; lane < max_size; lane++)
+    {
+        // Unused lanes hold an empty sphere at the origin, and are masked out of every hit.
+        const sphere *source = (lane < this->count) ? spheres[lane] : nullptr;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            center[axis][lane] = source ? source->center1[axis] : 0.0;
+            motion[axis][lane] = (source && source->is_moving) ? source->center_vec[axis] : 0.0;
+        }
+        radius[lane]         = source ? source->radius : 0.0;
+        material_index[lane] = 0;
+
+        if (source == nullptr) continue;
+
+        const auto known = std::find(materials.begin(), materials.end(), source->mat);
+        material_index[lane] = static_cast<uint8_t>(known - materials.begin());
+        if (known == materials.end()) materials.push_back(source->mat);
+
+        bbox = aabb(bbox, source->bounding_box());
+    }
+}
+
+/// Adds the spheres of every leaf under node to batches, or to list when a leaf holds only one.
+static void pack_leaves(const bvh_node &node, hittable_list &list)
+{
+    if (!node.is_leaf())
+    {
+        pack_leaves(*node.left_child(), list);
+        pack_leaves(*node.right_child(), list);
+        return;
+    }
+
+    const auto &objects = node.leaf_objects();
+    if (objects.size() == 1)
+    {
+        list.add(objects.front());
+        return;
+    }
+
+    const sphere *spheres[sphere_batch::max_size];
+    for (size_t index = 0; index < objects.size(); index++) spheres[index] = static_cast<const sphere *>(objects[index].get());
+    list.add(make_shared<sphere_batch>(spheres, static_cast<int>(objects.size())));
+}
+
+hittable_list sphere_batch::pack(const hittable_list &list, const int batch_size)
+{
+    hittable_list packed;
+    hittable_list spheres;
+    for (const auto &object : list.objects)
+    {
+        if (std::dynamic_pointer_cast<sphere>(object)) { spheres.add(object); } else { packed.add(object); }
+    }
+
+    if (spheres.objects.empty()) return packed;
+
+    // Group the spheres into the leaves of an SAH tree. Testing one more sphere of a batch costs a fraction of a node visit, so the
+    // intersection cost is lowered to match, which lets leaves grow toward batch_size where the spheres cluster.
+    bvh_build_options options;
+    options.split_method      = bvh_split_method::sah;
+    options.max_leaf_size     = std::clamp(batch_size, 1, max_size);
+    options.intersection_cost = 0.3;
+
+    const bvh_node grouping(spheres, options);
+    pack_leaves(grouping, packed);
+
+    return packed;
+}
+
+bool sphere_batch::hit(const ray &r, const interval ray_t, hit_record &rec) const
+{
+    // The same quadratic as sphere::hit, solved for four spheres at a time against one ray.
+    const f64x4 time = f64x4::broadcast(r.time());
+    const f64x4 a    = f64x4::broadcast(r.direction().length_squared());
+    const f64x4 zero = f64x4::broadcast(0.0);
+    const f64x4 t_lo = f64x4::broadcast(ray_t.min);
+
+    double closest      = ray_t.max;
+    int    closest_lane = -1;
+
+    for (int base = 0; base < count; base += 4)
+    {
+        f64x4 oc[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const f64x4 moved = f64x4::load(center[axis] + base) + time * f64x4::load(motion[axis] + base);
+            oc[axis]          = moved - f64x4::broadcast(r.origin()[axis]);
+        }
+
+        const f64x4 dx = f64x4::broadcast(r.direction().x());
+        const f64x4 dy = f64x4::broadcast(r.direction().y());
+        const f64x4 dz = f64x4::broadcast(r.direction().z());
+        const f64x4 rr = f64x4::load(radius + base);
+
+        const f64x4 h = dx * oc[0] + dy * oc[1] + dz * oc[2];
+        const f64x4 c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - rr * rr;
+
+        const f64x4 discriminant = h * h - a * c;
+        const f64x4 sqrtd        = sqrt(max(discriminant, zero));
+        const f64x4 t_hi         = f64x4::broadcast(closest);
+
+        const f64x4 near_root = (h - sqrtd) / a;
+        const f64x4 far_root  = (h + sqrtd) / a;
+        const f64x4 near_ok   = (near_root > t_lo) & (near_root < t_hi);
+        const f64x4 far_ok    = (far_root > t_lo) & (far_root < t_hi);
+        const f64x4 hit_lanes = (discriminant >= zero) & (near_ok | far_ok);
+
+        uint32_t hit_mask = static_cast<uint32_t>(hit_lanes.movemask());
+        if (count - base < 4) hit_mask &= (1u << (count - base)) - 1;
+        if (hit_mask == 0) continue;
+
+        alignas(32) double roots[4];
+        select(near_ok, near_root, far_root).store(roots);
+
+        for (; hit_mask != 0; hit_mask &= hit_mask - 1)
+        {
+            const int lane = std::countr_zero(hit_mask);
+            if (roots[lane] < closest)
+            {
+                closest      = roots[lane];
+                closest_lane = base + lane;
+            }
+        }
+    }
+
+    if (closest_lane < 0) return false;
+
+    // Filled in the way sphere does it, so a batched sphere shades exactly like the sphere it came from.
+    const point3 sphere_center(center[0][closest_lane], center[1][closest_lane], center[2][closest_lane]);
+
+    rec.t                     = closest;
+    rec.p                     = r.at(rec.t);
+    const vec3 outward_normal = (rec.p - sphere_center) / radius[closest_lane];
+    rec.set_face_normal(r, outward_normal);
+    sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+    rec.mat = materials[material_index[closest_lane]].get();
+
+    return true;
+}
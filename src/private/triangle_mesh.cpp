@@ -0,0 +1,396 @@
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+struct triangle_mesh::sheared_ray
+{
+    int   kx, ky, kz;                   // Axes of the sheared space: kz is the dominant axis of the direction
+    f64x4 origin_x, origin_y, origin_z; // The origin's coordinates along kx, ky and kz
+    f64x4 shear_x, shear_y, shear_z;    // Shear and scale that map the direction onto (0, 0, 1)
+
+    explicit sheared_ray(const ray &r)
+    {
+        const vec3  &d = r.direction();
+        const double ax = std::fabs(d.x()), ay = std::fabs(d.y()), az = std::fabs(d.z());
+        kz             = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+        kx             = (kz + 1) % 3;
+        ky             = (kx + 1) % 3;
+        // Swapping the other two axes for a negative direction keeps the winding, and so the signs of the areas, the same.
+        if (d[kz] < 0) std::swap(kx, ky);
+
+        origin_x = f64x4::broadcast(r.origin()[kx]);
+        origin_y = f64x4::broadcast(r.origin()[ky]);
+        origin_z = f64x4::broadcast(r.origin()[kz]);
+        shear_x  = f64x4::broadcast(d[kx] / d[kz]);
+        shear_y  = f64x4::broadcast(d[ky] / d[kz]);
+        shear_z  = f64x4::broadcast(1.0 / d[kz]);
+    }
+};
+
+triangle_mesh::triangle_mesh(shared_ptr<const mesh_buffers> buffers, shared_ptr<material> mat, const bvh_build_options &options,
+                             const triangle_leaf_layout layout)
+    : buffers(std::move(buffers)),
+      mat(std::move(mat)),
+      layout(layout)
+{
+    const mesh_buffers &mesh = *this->buffers;
+
+    if (mesh.indices.size() % 3 != 0)
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.indices.size() << " indices, which is not a whole number of triangles.\n";
+        return;
+    }
+    if (!mesh.normals.empty() && mesh.normals.size() != mesh.positions.size())
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.normals.size() << " normals for " << mesh.positions.size() << " positions.\n";
+        return;
+    }
+    if (!mesh.uvs.empty() && mesh.uvs.size() != 2 * mesh.positions.size())
+    {
+        std::cerr << "ERROR: Mesh has " << mesh.uvs.size() / 2 << " texture coordinates for " << mesh.positions.size() << " positions.\n";
+        return;
+    }
+
+    std::vector<triangle_ref> refs;
+    refs.reserve(mesh.triangle_count());
+    for (uint32_t triangle = 0; triangle < mesh.triangle_count(); triangle++)
+    {
+        const uint32_t *vertex = &mesh.indices[3 * triangle];
+        if (vertex[0] >= mesh.positions.size() || vertex[1] >= mesh.positions.size() || vertex[2] >= mesh.positions.size())
+        {
+            std::cerr << "ERROR: Mesh triangle " << triangle << " indexes past its " << mesh.positions.size() << " positions.\n";
+            return;
+        }
+
+        const aabb box(aabb(mesh.positions[vertex[0]], mesh.positions[vertex[1]]), aabb(mesh.positions[vertex[2]], mesh.positions[vertex[2]]));
+        refs.push_back({box, point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max) / 2, triangle});
+    }
+
+    if (refs.empty()) return;
+
+    bvh_build_options build_options = options;
+    if (layout != triangle_leaf_layout::indexed)
+    {
+        build_options.max_leaf_size = layout == triangle_leaf_layout::packed4 ? 4 : 8;
+        build_options.intersection_cost /= 4;
+    }
+
+    triangles.reserve(refs.size());
+    build_node(refs, 0, refs.size(), build_options);
+
+    const int depth = hierarchy_depth(nodes);
+    if (depth > traversal_stack_size)
+    {
+        std::cerr << "ERROR: Mesh BVH of depth " << depth << " is deeper than the " << traversal_stack_size << " levels it can traverse.\n";
+        nodes.clear();
+        triangles.clear();
+        return;
+    }
+    bbox = nodes.front().bbox;
+
+    if (layout != triangle_leaf_layout::indexed) pack_leaves();
+}
+
+size_t triangle_mesh::memory_bytes() const
+{
+    return sizeof(linear_bvh_node) * nodes.size() + sizeof(uint32_t) * triangles.size() + sizeof(triangle_packet) * packets.size();
+}
+
+uint32_t triangle_mesh::build_node(std::vector<triangle_ref> &refs, const size_t start, const size_t end, const bvh_build_options &options)
+{
+    aabb box       = aabb::empty;
+    aabb centroids = aabb::empty;
+    for (size_t index = start; index < end; index++)
+    {
+        box       = aabb(box, refs[index].box);
+        centroids = aabb(centroids, aabb(refs[index].centroid, refs[index].centroid));
+    }
+
+    const size_t count     = end - start;
+    const size_t leaf_size = static_cast<size_t>(std::clamp(options.max_leaf_size, 1, 0xFFFF));
+    if (count == 1) return add_leaf(refs, start, end, box);
+
+    const int       axis   = centroids.longest_axis();
+    const interval &extent = centroids.axis_interval(axis);
+
+    // Find the cheapest bucket boundary, as bvh_node::split_sah does. Every centroid at one spot along the axis leaves none to find.
+    const int bin_count  = std::max(options.sah_bins, 2);
+    int       best_split = 0;
+    double    best_cost  = infinity;
+
+    const auto bin_index = [&](const triangle_ref &ref) {
+        return std::min(static_cast<int>((ref.centroid[axis] - extent.min) / extent.size() * bin_count), bin_count - 1);
+    };
+
+    if (extent.size() > 0)
+    {
+        std::vector<aabb>   bin_boxes(bin_count, aabb::empty);
+        std::vector<size_t> bin_counts(bin_count, 0);
+        for (size_t index = start; index < end; index++)
+        {
+            const int b  = bin_index(refs[index]);
+            bin_boxes[b] = aabb(bin_boxes[b], refs[index].box);
+            bin_counts[b]++;
+        }
+
+        std::vector<double> right_cost(bin_count, 0.0);
+        aabb                right_box   = aabb::empty;
+        size_t              right_count = 0;
+        for (int b = bin_count - 1; b > 0; b--)
+        {
+            right_box = aabb(right_box, bin_boxes[b]);
+            right_count += bin_counts[b];
+            right_cost[b] = right_box.surface_area() * static_cast<double>(right_count);
+        }
+
+        const double node_area  = std::max(box.surface_area(), 1e-12);
+        aabb         left_box   = aabb::empty;
+        size_t       left_count = 0;
+        for (int b = 1; b < bin_count; b++)
+        {
+            left_box = aabb(left_box, bin_boxes[b - 1]);
+            left_count += bin_counts[b - 1];
+            if (left_count == 0 || left_count == count) continue;
+
+            const double cost = options.traversal_cost
+                                + options.intersection_cost * (left_box.surface_area() * static_cast<double>(left_count) + right_cost[b]) / node_area;
+            if (cost < best_cost)
+            {
+                best_cost  = cost;
+                best_split = b;
+            }
+        }
+    }
+
+    if (count <= leaf_size && options.intersection_cost * static_cast<double>(count) <= best_cost) return add_leaf(refs, start, end, box);
+
+    size_t mid = start;
+    if (best_split > 0)
+    {
+        mid = static_cast<size_t>(std::partition(refs.begin() + start, refs.begin() + end,
+                                                  [&](const triangle_ref &ref) { return bin_index(ref) < best_split; }) - refs.begin());
+    }
+    if (mid == start || mid == end)
+    {
+        mid = start + count / 2;
+        std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+                         [axis](const triangle_ref &a, const triangle_ref &b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({box, 0, 0, static_cast<uint8_t>(axis), 0});
+
+    build_node(refs, start, mid, options);
+    const uint32_t right = build_node(refs, mid, end, options);
+    nodes[index].offset  = right;
+    return index;
+}
+
+uint32_t triangle_mesh::add_leaf(const std::vector<triangle_ref> &refs, const size_t start, const size_t end, const aabb &box)
+{
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({box, static_cast<uint32_t>(triangles.size()), static_cast<uint16_t>(end - start), 0, 0});
+    for (size_t ref = start; ref < end; ref++) triangles.push_back(refs[ref].triangle);
+    return index;
+}
+
+void triangle_mesh::pack_leaves()
+{
+    const mesh_buffers &mesh = *buffers;
+    for (linear_bvh_node &node : nodes)
+    {
+        if (node.prim_count == 0) continue;
+
+        const auto first = static_cast<uint32_t>(packets.size());
+        for (uint32_t start = 0; start < node.prim_count; start += 4)
+        {
+            triangle_packet packet{};
+            for (uint32_t lane = 0; lane < 4 && start + lane < node.prim_count; lane++)
+            {
+                const uint32_t triangle = triangles[node.offset + start + lane];
+                packet.triangle[lane]   = triangle;
+                for (int v = 0; v < 3; v++)
+                {
+                    const point3 &p = mesh.positions[mesh.indices[3 * triangle + v]];
+                    for (int axis = 0; axis < 3; axis++) packet.vertex[v][axis][lane] = p[axis];
+                }
+            }
+            packets.push_back(packet);
+        }
+        node.offset = first;
+    }
+
+    triangles.clear();
+    triangles.shrink_to_fit();
+}
+
+bool triangle_mesh::hit(const ray &r, interval ray_t, hit_record &rec) const
+{
+    if (nodes.empty()) return false;
+
+    const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+    const bool dir_is_negative[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+    const sheared_ray sheared(r);
+
+    uint32_t         stack[traversal_stack_size];
+    int              stack_size = 0;
+    uint32_t         current    = 0;
+    uint32_t         closest    = 0;
+    double           closest_b1 = 0, closest_b2 = 0;
+    bool             hit_any    = false;
+    traversal_stats &stats      = thread_traversal_stats();
+
+    while (true)
+    {
+        const linear_bvh_node &node = nodes[current];
+        stats.node_visits++;
+
+        if (node.bbox.hit(r.origin(), inv_dir, ray_t))
+        {
+            if (node.prim_count > 0)
+            {
+                stats.primitive_tests += node.prim_count;
+                if (layout == triangle_leaf_layout::indexed)
+                {
+                    for (uint32_t i = node.offset; i < node.offset + node.prim_count; i++)
+                    {
+                        double t, b1, b2;
+                        if (hit_triangle(triangles[i], r, ray_t, t, b1, b2))
+                        {
+                            hit_any    = true;
+                            ray_t.max  = t;
+                            closest    = triangles[i];
+                            closest_b1 = b1;
+                            closest_b2 = b2;
+                        }
+                    }
+                } else
+                {
+                    for (int start = 0, packet = static_cast<int>(node.offset); start < node.prim_count; start += 4, packet++)
+                    {
+                        double   t, b1, b2;
+                        uint32_t triangle;
+                        if (hit_triangle_packet(packets[packet], std::min(node.prim_count - start, 4), sheared, ray_t, t, b1, b2, triangle))
+                        {
+                            hit_any    = true;
+                            ray_t.max  = t;
+                            closest    = triangle;
+                            closest_b1 = b1;
+                            closest_b2 = b2;
+                        }
+                    }
+                }
+            } else
+            {
+                // Visit the near child first and save the far child for later.
+                assert(stack_size < traversal_stack_size);
+                if (dir_is_negative[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current             = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    current             = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+
+    // Only the closest hit needs its normal and texture coordinates.
+    if (hit_any) set_hit_record(closest, r, ray_t.max, closest_b1, closest_b2, rec);
+    return hit_any;
+}
+
+bool triangle_mesh::hit_triangle(const uint32_t triangle, const ray &r, const interval &ray_t, double &t, double &b1, double &b2) const
+{
+    const uint32_t *vertex = &buffers->indices[3 * triangle];
+    return intersect_triangle(buffers->positions[vertex[0]], buffers->positions[vertex[1]], buffers->positions[vertex[2]], r, ray_t, t, b1, b2);
+}
+
+bool triangle_mesh::hit_triangle_packet(const triangle_packet &packet, const int lane_count, const sheared_ray &r,
+                                        const interval &ray_t, double &t, double &b1, double &b2, uint32_t &triangle)
+{
+    // Move the vertices relative to the ray origin, then shear and scale them so that the ray runs along +z.
+    f64x4 x[3], y[3], z[3];
+    for (int v = 0; v < 3; v++)
+    {
+        const f64x4 dz = f64x4::load(packet.vertex[v][r.kz]) - r.origin_z;
+        x[v]           = f64x4::load(packet.vertex[v][r.kx]) - r.origin_x - r.shear_x * dz;
+        y[v]           = f64x4::load(packet.vertex[v][r.ky]) - r.origin_y - r.shear_y * dz;
+        z[v]           = r.shear_z * dz;
+    }
+
+    // Twice the signed area each edge makes with the ray, which is the scaled barycentric weight of the opposite vertex.
+    const f64x4 u = x[2] * y[1] - y[2] * x[1];
+    const f64x4 v = x[0] * y[2] - y[0] * x[2];
+    const f64x4 w = x[1] * y[0] - y[1] * x[0];
+
+    // The ray misses where the areas have mixed signs, and a ray in the triangle's plane, or a degenerate triangle, has no area at all.
+    const f64x4 zero     = f64x4::broadcast(0);
+    const int   negative = ((u < zero) | (v < zero) | (w < zero)).movemask();
+    const int   positive = ((u > zero) | (v > zero) | (w > zero)).movemask();
+    const f64x4 det      = u + v + w;
+    const f64x4 dist     = (u * z[0] + v * z[1] + w * z[2]) / det;
+
+    int hits = ~(negative & positive) & ((det < zero) | (det > zero)).movemask() & ((1 << lane_count) - 1);
+    hits &= ((dist > f64x4::broadcast(ray_t.min)) & (dist < f64x4::broadcast(ray_t.max))).movemask();
+    if (hits == 0) return false;
+
+    alignas(32) double dists[4], vs[4], ws[4], dets[4];
+    dist.store(dists);
+    v.store(vs);
+    w.store(ws);
+    det.store(dets);
+
+    int closest = std::countr_zero(static_cast<unsigned>(hits));
+    for (int lane = closest + 1; lane < 4; lane++)
+    {
+        if ((hits >> lane & 1) && dists[lane] < dists[closest]) closest = lane;
+    }
+
+    t        = dists[closest];
+    b1       = vs[closest] / dets[closest];
+    b2       = ws[closest] / dets[closest];
+    triangle = packet.triangle[closest];
+    return true;
+}
+
+void triangle_mesh::set_hit_record(const uint32_t triangle, const ray &r, const double t, const double b1, const double b2, hit_record &rec) const
+{
+    const mesh_buffers &mesh   = *buffers;
+    const uint32_t     *vertex = &mesh.indices[3 * triangle];
+    const double        b0     = 1 - b1 - b2;
+
+    vec3 outward_normal;
+    if (!mesh.normals.empty())
+    {
+        outward_normal = unit_vector(b0 * mesh.normals[vertex[0]] + b1 * mesh.normals[vertex[1]] + b2 * mesh.normals[vertex[2]]);
+    } else
+    {
+        const point3 &p0 = mesh.positions[vertex[0]];
+        outward_normal   = unit_vector(cross(mesh.positions[vertex[1]] - p0, mesh.positions[vertex[2]] - p0));
+    }
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, outward_normal);
+
+    if (!mesh.uvs.empty())
+    {
+        rec.u = b0 * mesh.uvs[2 * vertex[0]] + b1 * mesh.uvs[2 * vertex[1]] + b2 * mesh.uvs[2 * vertex[2]];
+        rec.v = b0 * mesh.uvs[2 * vertex[0] + 1] + b1 * mesh.uvs[2 * vertex[1] + 1] + b2 * mesh.uvs[2 * vertex[2] + 1];
+    } else
+    {
+        rec.u = b1;
+        rec.v = b2;
+    }
+    rec.mat = mat.get();
+}
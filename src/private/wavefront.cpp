@@ -0,0 +1,167 @@
+#include "wavefront.h"
+
+#include "camera.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+
+wavefront_integrator::wavefront_integrator(const camera &cam, const size_t batch_size)
+    : cam(cam),
+      batch_size(batch_size < 1 ? 1 : batch_size) {}
+
+void wavefront_integrator::trace(const hittable &world, const std::vector<path_request> &requests, std::vector<color> &results)
+{
+    results.assign(requests.size(), color(0, 0, 0));
+
+    for (size_t first = 0; first < requests.size(); first += batch_size)
+    {
+        const size_t count = std::min(batch_size, requests.size() - first);
+        trace_batch(world, requests.data() + first, count, results.data() + first);
+    }
+}
+
+void wavefront_integrator::trace_batch(const hittable &world, const path_request *requests, const size_t count, color *results)
+{
+    generate(requests, count);
+
+    for (int bounce = 0; bounce < cam.max_depth && !active.empty(); bounce++)
+    {
+        intersect(world, results);
+        sort_by_material();
+        shade(bounce);
+    }
+
+    // Paths still active here ran out of bounces, and gather no light.
+}
+
+void wavefront_integrator::generate(const path_request *requests, const size_t count)
+{
+    for (auto *soa : {&origin_x, &origin_y, &origin_z, &direction_x, &direction_y, &direction_z, &time, &throughput_r, &throughput_g, &throughput_b})
+    {
+        soa->resize(count);
+    }
+    generator.resize(count);
+    hits.resize(count);
+    active.clear();
+
+    for (size_t path = 0; path < count; path++)
+    {
+        cam.seed_sample(requests[path].i, requests[path].j, requests[path].sample);
+        set_path_ray(static_cast<uint32_t>(path), cam.get_ray(requests[path].i, requests[path].j));
+
+        throughput_r[path] = throughput_g[path] = throughput_b[path] = 1.0;
+        generator[path]    = thread_rng();
+        active.push_back(static_cast<uint32_t>(path));
+    }
+}
+
+void wavefront_integrator::intersect(const hittable &world, color *results)
+{
+    // Keep the paths that hit something; paths that escape pick up the background and finish.
+    thread_traversal_stats().rays += active.size();
+
+    size_t hit_count = 0;
+    for (const uint32_t path : active)
+    {
+        const ray r = path_ray(path);
+        if (world.hit(r, interval(0.001, infinity), hits[path]))
+        {
+            active[hit_count++] = path;
+            continue;
+        }
+        results[path] = color(throughput_r[path], throughput_g[path], throughput_b[path]) * cam.background(r);
+    }
+    active.resize(hit_count);
+}
+
+void wavefront_integrator::sort_by_material()
+{
+    // Counting sort of the active paths by material type.
+    size_t counts[4] = {};
+    for (const uint32_t path : active) { counts[static_cast<int>(hits[path].mat->type())]++; }
+
+    bucket_start[0] = 0;
+    for (int bucket = 0; bucket < 4; bucket++) { bucket_start[bucket + 1] = bucket_start[bucket] + counts[bucket]; }
+
+    size_t next[4] = {bucket_start[0], bucket_start[1], bucket_start[2], bucket_start[3]};
+    sorted.resize(active.size());
+    for (const uint32_t path : active) { sorted[next[static_cast<int>(hits[path].mat->type())]++] = path; }
+}
+
+void wavefront_integrator::shade(const int bounce)
+{
+    next_active.clear();
+
+    shade_bucket<material>(material_type::other, bounce);
+    shade_bucket<lambertian>(material_type::lambertian, bounce);
+    shade_bucket<metal>(material_type::metal, bounce);
+    shade_bucket<dielectric>(material_type::dielectric, bounce);
+
+    std::swap(active, next_active);
+}
+
+template<typename Material>
+void wavefront_integrator::shade_bucket(const material_type type, const int bounce)
+{
+    const size_t end = bucket_start[static_cast<int>(type) + 1];
+    for (size_t index = bucket_start[static_cast<int>(type)]; index < end; index++)
+    {
+        const uint32_t path = sorted[index];
+
+        // Make this path's random number stream the current one while it scatters.
+        std::swap(thread_rng(), generator[path]);
+
+        const auto *mat = static_cast<const Material *>(hits[path].mat);
+        ray         scattered;
+        color       attenuation;
+        bool        alive;
+
+        if constexpr (std::is_same_v<Material, material>)
+        {
+            alive = mat->scatter(path_ray(path), hits[path], attenuation, scattered);
+        } else
+        {
+            alive = mat->Material::scatter(path_ray(path), hits[path], attenuation, scattered);
+        }
+
+        if (alive)
+        {
+            color throughput = color(throughput_r[path], throughput_g[path], throughput_b[path]) * attenuation;
+
+            // Russian roulette, exactly as in camera::ray_color. Only surviving paths are reweighted, so a zero throughput never divides.
+            if (bounce + 1 >= cam.rr_min_depth)
+            {
+                const double survival = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 1.0);
+                alive                 = random_double() < survival;
+                if (alive) throughput /= survival;
+            }
+
+            if (alive)
+            {
+                throughput_r[path] = throughput.x();
+                throughput_g[path] = throughput.y();
+                throughput_b[path] = throughput.z();
+            }
+        }
+
+        std::swap(thread_rng(), generator[path]);
+
+        if (!alive) continue;
+
+        set_path_ray(path, scattered);
+        next_active.push_back(path);
+    }
+}
+
+void wavefront_integrator::set_path_ray(const uint32_t path, const ray &r)
+{
+    origin_x[path]    = r.origin().x();
+    origin_y[path]    = r.origin().y();
+    origin_z[path]    = r.origin().z();
+    direction_x[path] = r.direction().x();
+    direction_y[path] = r.direction().y();
+    direction_z[path] = r.direction().z();
+    time[path]        = r.time();
+}
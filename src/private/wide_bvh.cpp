@@ -0,0 +1,206 @@
+#include "wide_bvh.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+
+template<int Width>
+wide_bvh<Width>::wide_bvh(const hittable_list &list, const bvh_build_options &options)
+    : wide_bvh(bvh_node(list, options)) {}
+
+template<int Width>
+wide_bvh<Width>::wide_bvh(const bvh_node &root)
+{
+    bbox = root.bounding_box();
+
+    // An empty scene has nothing to collapse, and its lone leaf would read as an interior child.
+    if (root.is_leaf() && root.leaf_objects().empty()) return;
+
+    collapse(root, 1);
+    if (depth > max_depth)
+    {
+        std::cerr << "ERROR: Wide BVH of depth " << depth << " is deeper than the " << max_depth << " levels it can traverse.\n";
+        nodes.clear();
+        primitives.clear();
+    }
+}
+
+template<int Width>
+uint32_t wide_bvh<Width>::collapse(const bvh_node &node, const int level)
+{
+    depth = std::max(depth, level);
+
+    std::vector<const bvh_node *> children;
+    if (node.is_leaf()) { children.push_back(&node); } else { children = {node.left_child().get(), node.right_child().get()}; }
+
+    while (children.size() < Width)
+    {
+        int    widest = -1;
+        double area   = -1;
+        for (int c = 0; c < static_cast<int>(children.size()); c++)
+        {
+            if (!children[c]->is_leaf() && children[c]->bounding_box().surface_area() > area)
+            {
+                widest = c;
+                area   = children[c]->bounding_box().surface_area();
+            }
+        }
+
+        if (widest < 0) break;
+
+        const bvh_node *opened = children[widest];
+        children[widest]       = opened->left_child().get();
+        children.push_back(opened->right_child().get());
+    }
+
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    for (int c = 0; c < static_cast<int>(children.size()); c++)
+    {
+        const bvh_node *child = children[c];
+
+        uint32_t offset     = 0;
+        uint16_t prim_count = 0;
+        if (child->is_leaf())
+        {
+            offset     = static_cast<uint32_t>(primitives.size());
+            prim_count = static_cast<uint16_t>(child->leaf_objects().size());
+            primitives.insert(primitives.end(), child->leaf_objects().begin(), child->leaf_objects().end());
+        } else
+        {
+            offset = collapse(*child, level + 1);
+        }
+
+        // Collapsing the child may have grown nodes, so look this node up again rather than holding a reference across the call.
+        wide_bvh_node<Width> &wide = nodes[index];
+        const aabb            box  = child->bounding_box();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            wide.bounds_min[axis][c] = box.axis_interval(axis).min;
+            wide.bounds_max[axis][c] = box.axis_interval(axis).max;
+        }
+        wide.offset[c]     = offset;
+        wide.prim_count[c] = prim_count;
+    }
+
+    // Unused slots hold an empty box; child_count keeps them out of every hit mask.
+    wide_bvh_node<Width> &wide = nodes[index];
+    for (int c = static_cast<int>(children.size()); c < Width; c++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            wide.bounds_min[axis][c] = infinity;
+            wide.bounds_max[axis][c] = -infinity;
+        }
+        wide.offset[c]     = 0;
+        wide.prim_count[c] = 0;
+    }
+    wide.child_count = static_cast<int>(children.size());
+
+    return index;
+}
+
+template<int Width>
+bool wide_bvh<Width>::hit(const ray &r, interval ray_t, hit_record &rec) const
+{
+    if (nodes.empty()) return false;
+
+    f64x4 orig[3], inv_dir[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        orig[axis]    = f64x4::broadcast(r.origin()[axis]);
+        inv_dir[axis] = f64x4::broadcast(1.0 / r.direction()[axis]);
+    }
+
+    struct entry
+    {
+        uint32_t offset;
+        uint16_t prim_count;
+        double   t_enter;
+    };
+
+    entry            stack[traversal_stack_size];
+    int              stack_size   = 0;
+    bool             hit_anything = false;
+    traversal_stats &stats        = thread_traversal_stats();
+
+    stack[stack_size++] = {0, 0, ray_t.min};
+
+    while (stack_size > 0)
+    {
+        const entry current = stack[--stack_size];
+
+        // The ray enters this child's box only behind the closest hit found since it was pushed.
+        if (current.t_enter >= ray_t.max) continue;
+
+        if (current.prim_count > 0)
+        {
+            stats.primitive_tests += current.prim_count;
+            for (uint32_t i = current.offset; i < current.offset + current.prim_count; i++)
+            {
+                if (primitives[i]->hit(r, ray_t, rec))
+                {
+                    hit_anything = true;
+                    ray_t.max    = rec.t;
+                }
+            }
+            continue;
+        }
+
+        const wide_bvh_node<Width> &node = nodes[current.offset];
+        stats.node_visits++;
+
+        // Slab test every child box at once, four per f64x4.
+        alignas(32) double t_enter[Width];
+        uint32_t           hit_mask = 0;
+        for (int base = 0; base < Width; base += 4)
+        {
+            f64x4 enter = f64x4::broadcast(ray_t.min);
+            f64x4 exit  = f64x4::broadcast(ray_t.max);
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const f64x4 t0 = (f64x4::load(node.bounds_min[axis] + base) - orig[axis]) * inv_dir[axis];
+                const f64x4 t1 = (f64x4::load(node.bounds_max[axis] + base) - orig[axis]) * inv_dir[axis];
+
+                enter = max(enter, min(t0, t1));
+                exit  = min(exit, max(t0, t1));
+            }
+
+            enter.store(t_enter + base);
+            hit_mask |= static_cast<uint32_t>((enter < exit).movemask()) << base;
+        }
+        hit_mask &= (1u << node.child_count) - 1;
+
+        // Order the children the ray enters from farthest to nearest, then push them in that order so the nearest is popped first.
+        int order[Width];
+        int hit_count = 0;
+        for (; hit_mask != 0; hit_mask &= hit_mask - 1)
+        {
+            const int child = std::countr_zero(hit_mask);
+
+            int slot = hit_count++;
+            for (; slot > 0 && t_enter[order[slot - 1]] < t_enter[child]; slot--) { order[slot] = order[slot - 1]; }
+            order[slot] = child;
+        }
+
+        assert(stack_size + hit_count <= traversal_stack_size);
+        for (int k = 0; k < hit_count; k++)
+        {
+            const int child     = order[k];
+            stack[stack_size++] = {node.offset[child], node.prim_count[child], t_enter[child]};
+        }
+    }
+
+    return hit_anything;
+}
+
+template<int Width>
+aabb wide_bvh<Width>::bounding_box() const { return bbox; }
+
+template class wide_bvh<4>;
+template class wide_bvh<8>;
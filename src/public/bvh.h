@@ -6,34 +6,178 @@
 #include "aabb.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "traversal_stats.h"
 
 #include <algorithm>
+#include <vector>
+
+/// BVH Split Method
+enum class bvh_split_method
+{
+    median, // Sort along the longest axis of the node's box and split at the median object
+    sah,    // Binned surface area heuristic: choose the bucket boundary with the lowest expected traversal cost
+    morton, // Linear BVH: sort centroids along a Morton (Z-order) curve and split where the leading code bit changes. Fastest to build
+    sbvh,   // Spatial split BVH: binned SAH that may also cut a node with a plane, putting straddling objects on both sides with clipped boxes
+};
+
+/// BVH Build Options
+/// @details Controls how bvh_node partitions objects, and how many threads share the work. The costs are the surface area heuristic's
+/// (SAH) cost model: the expected cost of a node is traversal_cost plus, for each child, the chance that a ray through the node also
+/// crosses the child (the ratio of their surface areas) times the child's object count times intersection_cost. Only their ratio matters.
+struct bvh_build_options
+{
+    bvh_split_method split_method      = bvh_split_method::median;
+    int              max_leaf_size     = 2;   // Most objects held by one leaf, up to the 65535 a linear_bvh_node counts
+    int              sah_bins          = 16;  // Buckets along the split axis for binned SAH
+    double           traversal_cost    = 1.0; // SAH cost of visiting an interior node
+    double           intersection_cost = 1.0; // SAH cost of testing one object
+    int              morton_bits       = 21;  // Bits per axis of the Morton code: 21 for a 63-bit code, 10 for a 30-bit one
+    double           spatial_alpha     = 1e-5; // SBVH: try a spatial split once object split children overlap by this fraction of root area
+    double           spatial_budget    = 1.0; // SBVH: most references spatial splits may add, as a fraction of the object count
+    int              treelet_passes    = 0;   // Rounds of treelet restructuring after the build (see bvh_node::optimize); 0 skips it
+    int              treelet_size      = 7;   // Leaves per restructured treelet, at most max_treelet_size
+    bool             print_build_time  = false; // Log the build time, and the cost and time of any treelet passes
+    bool             print_stats       = false; // Log a bvh_stats report of the tree once it is built
+
+    int    thread_count       = 0;       // Build threads; 0 or less uses every hardware thread
+    size_t parallel_threshold = 1 << 12; // Spans with fewer objects than this are built on a single thread
+};
 
 // Bounding Volume Hierarchy
 class bvh_node final : public hittable
 {
 public:
-    explicit bvh_node(hittable_list list);
+    explicit bvh_node(hittable_list list, const bvh_build_options &options = {});
 
-    bvh_node(std::vector<shared_ptr<hittable> > &objects, size_t start, size_t end);
+    /// @details Builds the hierarchy over objects [start, end), logging the build time if options.print_build_time is set. Large spans are
+    /// built task-parallel: each split hands one child to a new thread, dividing the remaining threads between the children by object
+    /// count, and the bounds and SAH bins of those spans are gathered by all of the node's threads at once.
+    bvh_node(std::vector<shared_ptr<hittable> > &objects, size_t start, size_t end, const bvh_build_options &options = {});
 
+    /// Hit
+    /// @details Tests the child nearer the ray origin first, judged by the ray direction along the split axis, then tests the other child only
+    /// in front of the closest hit found so far. Whole subtrees behind a hit are culled by their bounding box.
     bool hit(const ray &r, const interval ray_t, hit_record &rec) const override;
 
+    void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const override;
+
     aabb bounding_box() const override;
 
+    /// Refit
+    /// @details Recomputes every box bottom-up from the objects' current bounding boxes, keeping the shape of the tree. Call it after moving
+    /// objects (see sphere::move) instead of rebuilding; as objects drift from where the build put them the boxes grow and overlap, which
+    /// sah_cost measures.
+    void refit();
+
+    /// SAH Cost
+    /// @details The expected cost of tracing a ray that enters the root box, under the cost model of options: every node costs its chance
+    /// of being entered (its surface area over the root's) times traversal_cost, plus intersection_cost per object for leaves.
+    double sah_cost(const bvh_build_options &options) const;
+
+    /// Optimize
+    /// @details Lowers the SAH cost of the built tree by treelet restructuring, in options.treelet_passes rounds. Working bottom-up, each
+    /// interior node grows a treelet by repeatedly opening its largest-area treelet leaf until there are options.treelet_size leaves, then
+    /// finds the cheapest binary tree over those leaves by dynamic programming over every subset of them, and rebuilds the treelet in that
+    /// shape if it beats the current one. Objects never move between leaves; only the interior nodes are rearranged. Separate subtrees are
+    /// optimized on separate threads.
+    void optimize(const bvh_build_options &options);
+
+    bool is_leaf() const { return left == nullptr; }
+
+    /// @return The lower child of an interior node, or nullptr for a leaf.
+    const shared_ptr<bvh_node> &left_child() const { return left; }
+
+    /// @return The upper child of an interior node, or nullptr for a leaf.
+    const shared_ptr<bvh_node> &right_child() const { return right; }
+
+    /// @return The objects of a leaf, or an empty list for an interior node.
+    const std::vector<shared_ptr<hittable> > &leaf_objects() const { return objects; }
+
 private:
-    static bool box_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b, const int axis_index);
+    friend class linear_bvh;
+
+    /// Build Primitive
+    /// @details An object being sorted into the hierarchy, with its bounding box and centroid computed once up front.
+    struct build_primitive
+    {
+        shared_ptr<hittable> object;
+        aabb                 box;
+        point3               centroid;
+    };
+
+    /// Span Bounds
+    /// @details The box around a span of build primitives, and the box around their centroids.
+    struct span_bounds
+    {
+        aabb box       = aabb::empty;
+        aabb centroids = aabb::empty;
+    };
+
+    bvh_node() = default;
+
+    bvh_node(std::vector<build_primitive> &primitives, size_t start, size_t end, const bvh_build_options &options, int threads);
+
+    /// Build
+    /// @details Bounds primitives [start, end), then either keeps them as this node's leaf objects or splits them between two new children.
+    void build(std::vector<build_primitive> &primitives, size_t start, size_t end, const bvh_build_options &options, int threads);
+
+    static std::vector<build_primitive> make_build_primitives(const std::vector<shared_ptr<hittable> > &objects, size_t start, size_t end,
+                                                              int threads);
+
+    static span_bounds bound_span(const std::vector<build_primitive> &primitives, size_t start, size_t end, int threads);
+
+    /// Sort By Morton Code
+    /// @details Quantizes every centroid to options.morton_bits per axis within the centroid bounds, interleaves the bits into a Morton
+    /// code, and radix sorts the primitives by code.
+    /// @return The sorted codes, parallel to primitives.
+    static std::vector<uint64_t> sort_by_morton_code(std::vector<build_primitive> &primitives, const bvh_build_options &options, int threads);
+
+    /// Build Morton
+    /// @details Builds the subtree over primitives [start, end), already sorted by Morton code, by splitting where the highest bit that
+    /// differs across the span turns on. Boxes are merged bottom-up from the children, so the whole build is a sort plus linear work.
+    void build_morton(std::vector<build_primitive> &primitives, const std::vector<uint64_t> &codes, size_t start, size_t end,
+                      const bvh_build_options &options, int threads);
+
+    static constexpr int max_treelet_size = 8; // Largest treelet; the subset search costs 3^size steps
+
+    /// @return The area-weighted SAH cost of this subtree after restructuring its treelets, children before parents.
+    double optimize_subtree(const bvh_build_options &options, int threads);
+
+    /// @details Restructures the treelet rooted at this node, whose descendants have already been optimized.
+    /// @return The area-weighted SAH cost of this subtree afterwards.
+    double restructure_treelet(const bvh_build_options &options, double left_cost, double right_cost);
+
+    /// @details Points left and right at the given children, ordered along the axis that best separates them, and bounds them.
+    void set_children(shared_ptr<bvh_node> first, shared_ptr<bvh_node> second);
+
+    /// @return The sum over this subtree of each node's surface area times its SAH cost, which sah_cost divides by the root's area.
+    double area_weighted_cost(const bvh_build_options &options) const;
+
+    /// @return The index in [start, end) where the objects are split by the median rule, after partitioning them along axis.
+    size_t split_median(std::vector<build_primitive> &primitives, size_t start, size_t end) const;
 
-    static bool box_x_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b);
+    /// @param split_cost If given, receives the SAH cost of the chosen split relative to this node, or infinity when there is none.
+    /// @return The index in [start, end) where the objects are split by binned SAH, or end if a leaf is cheaper than any split.
+    size_t split_sah(std::vector<build_primitive> &primitives, size_t start, size_t end, const aabb &centroid_bounds,
+                     const bvh_build_options &options, int threads, double *split_cost = nullptr);
 
-    static bool box_y_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b);
+    static constexpr int max_spatial_depth = 48; // Deepest node that may still split spatially, which bounds runaway duplication
 
-    static bool box_z_compare(const shared_ptr<hittable> &a, const shared_ptr<hittable> &b);
+    /// Build Spatial
+    /// @details Builds an SBVH node over references, objects paired with the part of their box that falls inside this node. Each node
+    /// prices the best binned SAH object split and, where that split's children overlap, the best spatial split: a plane across the node
+    /// that clips the references straddling it into one reference on each side. The spatial split wins if it's cheaper and the duplicate
+    /// references fit in what remains of budget.
+    void build_spatial(std::vector<build_primitive> references, const bvh_build_options &options, double root_area, size_t &budget,
+                       int depth);
 
 private:
-    shared_ptr<hittable> left;
-    shared_ptr<hittable> right;
-    aabb                 bbox;
+    shared_ptr<bvh_node>               left;
+    shared_ptr<bvh_node>               right;
+    std::vector<shared_ptr<hittable> > objects; // Leaf objects; empty for interior nodes
+    aabb                               bbox;
+    int                                axis         = 0; // Axis the objects were split along; left holds the lower part
+    double                             subtree_cost = 0; // Area-weighted SAH cost of this subtree as of the last optimization pass
 };
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include "includes.h"
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+
+#include <string>
+
+/// BVH Cache Version
+/// @details Bumped whenever the cache file layout or linear_bvh_node changes, so stale files are rebuilt rather than misread.
+constexpr uint32_t bvh_cache_version = 1;
+
+/// BVH Scene Hash
+/// @details Hashes everything a BVH build depends on: the number, order and bounding boxes of the objects, and the build options that
+/// shape the tree. Materials and textures don't affect the tree, so changing them keeps the cache valid.
+uint64_t bvh_scene_hash(const hittable_list &list, const bvh_build_options &options);
+
+/// Save BVH Cache
+/// @details Writes bvh to path as a versioned binary file: a header, the nodes exactly as linear_bvh lays them out in memory, and the
+/// primitives as indices into list. The file is written to a scratch path and renamed into place, so readers never see a partial one.
+/// @return Whether the file was written.
+bool save_bvh_cache(const std::string &path, const linear_bvh &bvh, const hittable_list &list, uint64_t scene_hash);
+
+/// Load BVH Cache
+/// @details Memory-maps a file written by save_bvh_cache and traverses its nodes in place, so loading costs no parsing and no copying
+/// of the node array.
+/// @return The hierarchy over list, or nullptr if the file is missing, from another version or machine layout, or for another scene.
+shared_ptr<linear_bvh> load_bvh_cache(const std::string &path, const hittable_list &list, uint64_t scene_hash);
+
+/// Cached Linear BVH
+/// @details Loads the hierarchy for list from cache_directory, in a file named after the scene hash, or builds it and saves it there for
+/// next time.
+shared_ptr<linear_bvh> cached_linear_bvh(const hittable_list &list, const std::string &cache_directory, const bvh_build_options &options = {});
+
+#endif
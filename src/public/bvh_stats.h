@@ -0,0 +1,42 @@
+#ifndef BVH_STATS_H
+#define BVH_STATS_H
+
+#include "includes.h"
+
+#include "bvh.h"
+
+#include <ostream>
+#include <vector>
+
+/// BVH Statistics
+/// @details Measures the shape and quality of a built bvh_node hierarchy, to compare builders and their options on a real scene. Overlap
+/// is the surface area two sibling boxes share as a fraction of their parent's: a ray crossing the shared region has to visit both
+/// children, so the lower it is the better the split. Memory counts the nodes and their leaf object lists, but not the control blocks of
+/// the shared pointers or the objects themselves. Pair it with the per-ray counts camera::render logs from traversal_stats.
+struct bvh_stats
+{
+    size_t interior_count  = 0; // Nodes with two children
+    size_t leaf_count      = 0; // Nodes holding objects
+    size_t reference_count = 0; // Objects over all leaves; more than the scene's when spatial splits duplicate them
+
+    std::vector<size_t> leaf_depths; // Leaves at each depth, from the root at depth 0
+    std::vector<size_t> leaf_sizes;  // Leaves holding each number of objects
+
+    double sah_cost     = 0; // bvh_node::sah_cost of the whole tree
+    double mean_overlap = 0; // Mean over interior nodes of the children's overlap area over the node's area
+    double max_overlap  = 0; // Largest such fraction
+
+    size_t node_bytes   = 0; // Memory held by the bvh_node tree
+    size_t linear_bytes = 0; // Memory the tree would take flattened into a linear_bvh
+
+    /// @details Walks the tree under root, pricing its SAH cost with the cost model in options.
+    explicit bvh_stats(const bvh_node &root, const bvh_build_options &options = {});
+
+    /// @details Writes a short report of every statistic, a few lines long.
+    void print(std::ostream &out) const;
+
+private:
+    void add_node(const bvh_node &node, size_t depth);
+};
+
+#endif
@@ -1,8 +1,20 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "framebuffer.h"
 #include "hittable.h"
 #include "material.h"
+#include "traversal_stats.h"
+#include "wavefront.h"
+
+#include <string>
+
+/// Render Engine
+enum class render_engine
+{
+    depth_first, // Follow each path to its end with camera::ray_color before starting the next
+    wavefront,   // Advance batches of paths one bounce at a time with a wavefront_integrator
+};
 
 class camera
 {
@@ -12,10 +24,57 @@ public:
     void initialize();
 
     /// Render Image
-    /// @details This method calls camera::initialize, then iterates through each pixel within the viewport, additively sampling color at the given ray
-    /// location, per number of samples. The final pixel color is written to file.
+    /// @details This method calls camera::initialize, then renders the image in one or more progressive passes into an accumulation framebuffer.
+    /// Each pass adds up to samples_per_pass samples to every pixel that is still sampling. Between passes, a snapshot of the image so far is
+    /// written to snapshot_path every snapshot_passes passes or every snapshot_seconds seconds, so a job can be inspected and cancelled early.\n
+    /// With adaptive sampling enabled (adaptive_threshold > 0), each pixel stops sampling once the estimated relative error of its mean falls
+    /// below the threshold. The samples it did not need remain in the budget of samples_per_pixel times the pixel count, and later passes spend
+    /// them on the pixels that are still noisy, up to max_pixel_samples each. Rendering ends when every pixel has converged or the budget is
+    /// spent, and the framebuffer is written to standard output in one bulk pass, using output_format. The rays traced and the BVH work they
+    /// took are logged at the end, and kept in render_stats.
     void render(const hittable &world);
 
+    /// @return The traversal counters of every worker thread, summed over the last render.
+    const traversal_stats &render_stats() const { return last_render_stats; }
+
+    /// Render Pass
+    /// @details Splits the viewport into square tiles which are handed out to a pool of worker threads, and adds up to sample_count samples to
+    /// every pixel that is still sampling. The traversal work of every tile is added to stats.
+    /// @return The number of samples taken.
+    size_t render_pass(const hittable &world, int sample_count, framebuffer &image, traversal_stats &stats) const;
+
+    /// Render Tile
+    /// @details Adds up to sample_count samples to every pixel still sampling in the half-open pixel rectangle [x0, x1) x [y0, y1), continuing
+    /// each pixel's sample numbering where it left off. Tiles never overlap, so several threads may render into the same framebuffer at once.
+    /// Paths are traced with the selected engine.
+    /// @return The number of samples taken.
+    size_t render_tile(const hittable &world, int x0, int y0, int x1, int y1, int sample_count, framebuffer &image) const;
+
+    /// Trace Packets
+    /// @details Traces one path per request, like render_tile's single-ray loop, but intersects the camera rays packet_size at a time with
+    /// hittable::hit_packet. Consecutive requests are samples of the same or neighboring pixels, so their camera rays are coherent and share
+    /// most of their way through the BVH. From the first hit on, each path continues as a single ray.
+    void trace_packets(const hittable &world, const std::vector<path_request> &requests, std::vector<color> &results) const;
+
+    /// @return The most samples any single pixel may take: samples_per_pixel, or the adaptive cap when adaptive sampling is enabled.
+    int max_pixel_samples() const;
+
+    /// Pixel Active
+    /// @return True if pixel i, j should take more samples: it is below max_pixel_samples and, under adaptive sampling, either has fewer than
+    /// adaptive_min_samples samples or has not yet reached adaptive_threshold.
+    bool pixel_active(const framebuffer &image, int i, int j) const;
+
+    size_t count_active_pixels(const framebuffer &image) const;
+
+    /// Write Snapshot
+    /// @details Writes the image accumulated so far to snapshot_path, replacing the previous snapshot in a single step.
+    void write_snapshot(const framebuffer &image) const;
+
+    /// Seed Sample
+    /// @details Reseeds the calling thread's generator from the camera seed, the pixel location i, j, and the sample index. Every sample draws
+    /// the same random numbers no matter which thread renders it, so images are bit-for-bit reproducible for any thread count or tile size.
+    void seed_sample(const int i, const int j, const int sample) const;
+
     /// Sample Unit Square
     /// @return A 3-dimensional vector of a random point in the [-0.5, -0.5] -> [+0.5, +0.5] unit square, such that X and Y are random values and Z is 0.
     static vec3 sample_square();
@@ -24,13 +83,45 @@ public:
 
     ray get_ray(const int i, const int j) const;
 
+    /// Background
+    /// @return The color of the sky seen along the ray r: a vertical gradient from white to light blue.
+    color background(const ray &r) const;
+
+    /// Ray Color
+    /// @details Follows a light path from the ray r for at most depth segments. The path is traced in a loop that carries the product of every
+    /// attenuation so far (the path throughput) instead of recursing once per bounce. After rr_min_depth bounces, Russian roulette ends the path
+    /// with a probability that grows as the throughput shrinks, and surviving paths are scaled up by the inverse of their survival chance. Dim paths
+    /// are cut short, and the expected color stays unchanged.
+    /// @return The color carried back along the path.
     color ray_color(const ray &r, const int depth, const hittable &world) const;
 
+    /// Continue Path
+    /// @details The body of ray_color, for a ray whose first intersection has already been found.
+    /// @param first_hit The closest hit of r, or nullptr if it hits nothing.
+    color continue_path(const ray &r, const hit_record *first_hit, const int depth, const hittable &world) const;
+
 public:
-    double aspect_ratio      = 1.0; // Ratio of image width over height
-    int    image_width       = 100; // Rendered image width in pixel count
-    int    samples_per_pixel = 10;  // Count of random samples for each pixel
-    int    max_depth         = 10;  // Maximum number of ray bounces into scene
+    double   aspect_ratio      = 1.0; // Ratio of image width over height
+    int      image_width       = 100; // Rendered image width in pixel count
+    int      samples_per_pixel = 10;  // Count of random samples for each pixel
+    int      max_depth         = 10;  // Maximum number of ray bounces into scene
+    int      thread_count      = 0;   // Worker threads used to render; 0 uses every hardware thread
+    int      tile_size         = 16;  // Edge length, in pixels, of the square tiles handed to worker threads
+    uint64_t seed              = 0;   // Base seed for per-sample random number streams
+    int      rr_min_depth      = 3;   // Bounces traced before Russian roulette may end a path
+    int      packet_size       = 0;   // Camera rays intersected together as a SIMD packet (4, 8 or 16); 0 traces them one at a time
+
+    int    samples_per_pass = 0; // Samples added to every pixel per progressive pass; 0 renders every sample in one pass
+    int    snapshot_passes  = 0; // Passes between snapshots; 0 disables pass-based snapshots
+    double snapshot_seconds = 0; // Seconds between snapshots; 0 disables timed snapshots
+
+    double adaptive_threshold   = 0;  // Target relative error of each pixel's mean; 0 gives every pixel exactly samples_per_pixel samples
+    int    adaptive_min_samples = 16; // Samples every pixel takes before its error is estimated
+    int    adaptive_max_samples = 0;  // Most samples one pixel may take under adaptive sampling; 0 uses 4 x samples_per_pixel
+
+    render_engine engine        = render_engine::depth_first; // Path tracing engine
+    image_format  output_format = image_format::ppm_ascii;    // File format of the rendered image and snapshots
+    std::string   snapshot_path = "snapshot.ppm";             // File that progressive snapshots are written to
 
     double vFov     = 90;               // Vertical view angle (Field of View)
     point3 lookFrom = point3(0, 0, 0);  // Point camera is looking from
@@ -42,7 +133,6 @@ public:
 
 private:
     int    image_height{};        // Rendered image height
-    double pixel_samples_scale{}; // Color scale factor for a sum of pixel samples
     point3 center;                // Camera center
     point3 pixel100_loc;          // Location of pixel 0, 0
     vec3   pixel_delta_u;         // Offset to pixel to the right
@@ -50,6 +140,8 @@ private:
     vec3   u, v, w;               // Camera frame basis vectors
     vec3   defocus_disk_u;        // Defocus disk horizontal radius
     vec3   defocus_disk_v;        // Defocus disk vertical radius
+
+    traversal_stats last_render_stats; // Traversal counters summed over the last render
 };
 
 #endif
@@ -12,7 +12,15 @@ inline double linear_to_gamma(const double linear_component)
     return 0;
 }
 
-inline void write_color(std::ostream &out, const color &pixel_color)
+/// Luminance
+/// @return The relative luminance (Rec. 709 weights) of a linear color.
+inline double luminance(const color &pixel_color) { return 0.2126 * pixel_color.x() + 0.7152 * pixel_color.y() + 0.0722 * pixel_color.z(); }
+
+/// Color To Bytes
+/// @details Converts a linear color to gamma space and translates each [0,1] component to the byte range [0,255].
+/// @param pixel_color A const reference to the linear color.
+/// @param bytes The three output bytes, in red, green, blue order.
+inline void color_to_bytes(const color &pixel_color, unsigned char bytes[3])
 {
     // Converting RGB values from linear to gamma space
     auto r = pixel_color.x();
@@ -26,12 +34,18 @@ inline void write_color(std::ostream &out, const color &pixel_color)
 
     // Translate the [0,1] component values to the byte range [0,255].
     static const interval intensity(0.000, 0.999);
-    const int             rbyte = static_cast<int>(256 * intensity.clamp(r));
-    const int             gbyte = static_cast<int>(256 * intensity.clamp(g));
-    const int             bbyte = static_cast<int>(256 * intensity.clamp(b));
+    bytes[0] = static_cast<unsigned char>(256 * intensity.clamp(r));
+    bytes[1] = static_cast<unsigned char>(256 * intensity.clamp(g));
+    bytes[2] = static_cast<unsigned char>(256 * intensity.clamp(b));
+}
+
+inline void write_color(std::ostream &out, const color &pixel_color)
+{
+    unsigned char bytes[3];
+    color_to_bytes(pixel_color, bytes);
 
     // Write out the pixel color components.
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+    out << static_cast<int>(bytes[0]) << ' ' << static_cast<int>(bytes[1]) << ' ' << static_cast<int>(bytes[2]) << '\n';
 }
 
 #endif
@@ -0,0 +1,127 @@
+#ifndef COMPRESSED_MESH_H
+#define COMPRESSED_MESH_H
+
+#include "includes.h"
+
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "triangle_mesh.h"
+
+#include <span>
+#include <vector>
+
+/// Compressed Mesh
+/// @details A triangle mesh stored in a fraction of the memory of a triangle_mesh, for models too large to keep in doubles. Triangles are
+/// sorted along a Morton curve through their centroids and cut into clusters of at most cluster_size neighbors, and each cluster keeps its
+/// own copy of the vertices its triangles use: positions as three 16-bit offsets on a grid fitted to the cluster's bounds, normals
+/// octahedral encoded into two 16-bit values, and texture coordinates as 16-bit fractions of the cluster's texture coordinate range.
+/// Triangles index vertices with 16 bits, and each cluster has its own SAH hierarchy of 16-byte nodes, with bounds on the same grid.
+/// Everything is decoded on the fly while a ray is traced.
+///
+/// The mesh is built straight from its buffers: the hierarchy above the clusters splits where the Morton codes do, as
+/// bvh_split_method::morton, so no hierarchy over the full precision triangles is ever made, and the buffers can be freed once the
+/// constructor returns.
+///
+/// Cluster grids are power-of-two multiples of one grid spanning the whole mesh, so a vertex shared by neighboring clusters decodes to
+/// the same point in each when their grids are equally fine, and moves by at most half a cluster grid step otherwise. Positions are good
+/// to about one part in 2^17 of a cluster's size.
+class compressed_mesh final : public hittable
+{
+public:
+    static constexpr int max_cluster_size = 255; // Most triangles one cluster holds, so that its leaves fit 8-bit counts
+
+    /// @details Checks the buffers and compresses every triangle in them into clusters of at most cluster_size triangles. Buffers that
+    /// don't describe a valid mesh are reported and leave it empty.
+    compressed_mesh(const mesh_buffers &mesh, shared_ptr<material> mat, int cluster_size = 64);
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+
+    aabb bounding_box() const override { return bbox; }
+
+    /// @return The bytes taken by the clusters, their vertices and the hierarchy.
+    size_t memory_bytes() const;
+
+    size_t cluster_count() const { return clusters.size(); }
+
+private:
+    static constexpr int traversal_stack_size = 128; // Deepest tree above the clusters the traversal stack can hold
+    static constexpr int max_leaf_size        = 4;   // Most triangles in a leaf of a cluster's hierarchy
+
+    /// A triangle while the clusters are formed, with the Morton code of its centroid.
+    struct triangle_key
+    {
+        uint64_t code;
+        uint32_t triangle;
+    };
+
+    /// A triangle of a cluster while its hierarchy is built.
+    struct cluster_triangle
+    {
+        uint16_t lower[3]; // Bounds on the cluster's grid
+        uint16_t upper[3];
+        uint16_t corner[3]; // Cluster vertex indices
+    };
+
+    /// A node of a cluster's hierarchy, depth-first as linear_bvh_node.
+    struct cluster_node
+    {
+        uint16_t lower[3]; // Bounds on the cluster's grid
+        uint16_t upper[3];
+        uint16_t offset;   // Leaf: first triangle in the cluster. Interior: second child in the cluster
+        uint8_t  count;    // Number of triangles in a leaf; 0 for interior nodes
+        uint8_t  axis;
+    };
+
+    struct mesh_cluster
+    {
+        int32_t  base[3];        // Cluster grid origin, in mesh grid steps
+        int32_t  shift;          // The cluster grid step is 2^shift mesh grid steps
+        uint32_t first_node;     // Index of the cluster's root in cluster_nodes
+        uint32_t first_vertex;   // Index of the cluster's first vertex in the vertex arrays
+        uint32_t first_triangle; // Index of the cluster's first triangle in corners
+        double   uv_min[2];      // Lowest texture coordinates of the cluster
+        double   uv_scale[2];    // Texture coordinate range of the cluster over 65535
+    };
+
+    point3                       origin;   // Mesh grid origin
+    double                       step = 0; // Mesh grid step
+    shared_ptr<material>         mat;
+    std::vector<linear_bvh_node> nodes;     // Hierarchy above the clusters; a leaf is the one cluster at its offset
+    std::vector<mesh_cluster>    clusters;
+    std::vector<cluster_node>    cluster_nodes;
+    std::vector<uint16_t>        corners;   // Three cluster vertex indices per triangle
+    std::vector<uint16_t>        positions; // Three per vertex
+    std::vector<int16_t>         normals;   // Two per vertex, or none
+    std::vector<uint16_t>        uvs;       // Two per vertex, or none
+    aabb                         bbox = aabb::empty;
+
+    /// Build Node
+    /// @details Appends the hierarchy over keys, sorted by code, as one cluster if it holds at most cluster_size triangles, and otherwise
+    /// as an interior node split where the highest differing code bit changes, over two subtrees built the same way.
+    /// @return The bounds of the decoded subtree.
+    aabb build_node(const mesh_buffers &mesh, std::span<const triangle_key> keys, int cluster_size);
+
+    /// Add Cluster
+    /// @details Quantizes the triangles of keys into a new cluster, and builds its hierarchy.
+    /// @return The bounds of the decoded cluster.
+    aabb add_cluster(const mesh_buffers &mesh, std::span<const triangle_key> keys);
+
+    /// Build Cluster Node
+    /// @details Appends the subtree of the cluster's hierarchy over triangles, splitting at the lowest cost centroid boundary of a full
+    /// SAH sweep along each axis, and appends each leaf's triangles to corners as it is made.
+    void build_cluster_node(const mesh_cluster &cluster, std::span<cluster_triangle> triangles);
+
+    point3 decode_position(const mesh_cluster &cluster, const uint16_t *quantized) const;
+
+    /// Hit Cluster
+    /// @details Traverses the cluster's hierarchy, shrinking ray_t to the closest hit as triangle_mesh::hit does.
+    /// @return True if r hits one of the cluster's triangles inside ray_t, with triangle, b1 and b2 set for the closest.
+    bool hit_cluster(const mesh_cluster &cluster, const ray &r, const vec3 &inv_dir, interval &ray_t, uint32_t &triangle, double &b1,
+                     double &b2) const;
+
+    /// @details triangle is the index of the triangle in corners.
+    void set_hit_record(const mesh_cluster &cluster, uint32_t triangle, const ray &r, double t, double b1, double b2,
+                        hit_record &rec) const;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef DYNAMIC_BVH_H
+#define DYNAMIC_BVH_H
+
+#include "includes.h"
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <vector>
+
+/// Dynamic Bounding Volume Hierarchy
+/// @details A bvh_node hierarchy for animated scenes, kept up to date frame by frame. After the objects move, update refits the tree
+/// bottom-up, which costs one pass over the nodes rather than a full build. Refitting keeps the tree's shape, so as objects wander away
+/// from where the build grouped them the boxes swell and traversal slows; once the refit tree's SAH cost has grown past rebuild_threshold
+/// over the cost right after its last build, update rebuilds it from scratch instead.
+class dynamic_bvh final : public hittable
+{
+public:
+    /// @param list The objects, which the caller moves between frames.
+    /// @param options How to build the hierarchy, initially and whenever it is rebuilt.
+    /// @param rebuild_threshold Fraction by which the SAH cost may grow over the built tree's before update rebuilds. 0 or less rebuilds
+    /// on every update; infinity never does.
+    explicit dynamic_bvh(const hittable_list &list, const bvh_build_options &options = {}, const double rebuild_threshold = 0.5)
+        : objects(list.objects),
+          options(options),
+          rebuild_threshold(rebuild_threshold)
+    {
+        rebuild();
+    }
+
+    /// Update
+    /// @details Brings the hierarchy up to date after the objects have moved, by refitting it or, past the rebuild threshold, rebuilding it.
+    /// @return Whether the hierarchy was rebuilt.
+    bool update()
+    {
+        root->refit();
+
+        if (root->sah_cost(options) <= built_cost * (1 + rebuild_threshold)) return false;
+
+        rebuild();
+        return true;
+    }
+
+    bool hit(const ray &r, const interval ray_t, hit_record &rec) const override { return root->hit(r, ray_t, rec); }
+
+    void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const override
+    {
+        root->hit_packet(rays, t_min, lane_mask, hits);
+    }
+
+    aabb bounding_box() const override { return root->bounding_box(); }
+
+    const bvh_node &tree() const { return *root; }
+
+private:
+    std::vector<shared_ptr<hittable> > objects;
+    bvh_build_options                  options;
+    double                             rebuild_threshold;
+    shared_ptr<bvh_node>               root;
+    double                             built_cost = 0; // SAH cost of the tree right after its last build
+
+    void rebuild()
+    {
+        root       = make_shared<bvh_node>(objects, 0, objects.size(), options);
+        built_cost = root->sah_cost(options);
+    }
+};
+
+#endif
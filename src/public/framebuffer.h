@@ -0,0 +1,63 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "includes.h"
+
+#include <vector>
+
+/// Image File Format
+enum class image_format
+{
+    ppm_ascii,  // Plain PPM (P3): one line of decimal RGB values per pixel
+    ppm_binary, // Raw PPM (P6): three bytes per pixel
+};
+
+/// Framebuffer
+/// @details An in-memory accumulation image of linear RGB colors, stored as three floats per pixel, row by row from the top left, next to the
+/// number of samples each pixel has received and the sum of their squared luminance, from which the noise left in each pixel is estimated.
+/// Renderers add samples while tracing, possibly over several passes, and the image is written
+/// out in one bulk pass afterward. The whole file is encoded into a single buffer and handed to the stream with one write, so output never
+/// interleaves with tracing.
+class framebuffer
+{
+public:
+    framebuffer() = default;
+
+    framebuffer(const int width, const int height);
+
+    int width() const { return image_width; }
+
+    int height() const { return image_height; }
+
+    /// @details Adds sample_count linear color samples to pixel i, j, given their sum and the sum of their squared luminance. Distinct pixels
+    /// may be updated concurrently from different threads.
+    void add_samples(const int i, const int j, const color &sample_sum, const double luminance_square_sum, const int sample_count);
+
+    int sample_count(const int i, const int j) const { return samples[index(i, j)]; }
+
+    /// @return The mean of every sample added to pixel i, j, or black if it has none.
+    color pixel(const int i, const int j) const;
+
+    /// Relative Error
+    /// @details Estimates how far the mean luminance of pixel i, j may still be from its converged value: the standard error of the mean,
+    /// from the sample variance, divided by the mean. Very dark pixels are measured against a small floor instead, so they are not refined
+    /// forever.
+    /// @return The estimated relative error, or infinity if the pixel has fewer than two samples.
+    double relative_error(const int i, const int j) const;
+
+    /// Write Image
+    /// @details Converts every pixel mean from linear to gamma space, quantizes it to a byte per channel, and writes the image to out in the
+    /// given format. The framebuffer may keep accumulating afterward, so this also serves for intermediate snapshots.
+    void write(std::ostream &out, const image_format format) const;
+
+private:
+    int                image_width  = 0;
+    int                image_height = 0;
+    std::vector<float> rgb;               // Sum of linear RGB samples, three floats per pixel
+    std::vector<float> luminance_squares; // Sum of squared sample luminance per pixel
+    std::vector<int>   samples;           // Number of samples summed into each pixel
+
+    size_t index(const int i, const int j) const { return static_cast<size_t>(j) * image_width + i; }
+};
+
+#endif
@@ -4,19 +4,20 @@
 #include "includes.h"
 
 #include "aabb.h"
+#include "packet.h"
 
 class material;
 
 class hit_record
 {
 public:
-    vec3                 p;
-    vec3                 normal;
-    shared_ptr<material> mat;
-    double               t;
-    double               u;
-    double               v;
-    bool                 front_face;
+    vec3            p;
+    vec3            normal;
+    const material *mat; // Non-owning; the hit object keeps its material alive
+    double          t;
+    double          u;
+    double          v;
+    bool            front_face;
 
     void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
@@ -25,6 +26,21 @@ public:
     }
 };
 
+/// Packet Hit
+/// @details The closest hits found so far for each lane of a ray_packet. t_max starts at the far end of each lane's interval and shrinks
+/// as closer hits are found, so later objects are only tested against the part of the ray still in front of the closest hit.
+struct packet_hit
+{
+    alignas(32) double t_max[max_packet_size];
+    hit_record         rec[max_packet_size];
+    uint32_t           hit_mask = 0; // Bit n is set if lane n has hit something
+
+    explicit packet_hit(const double far = infinity)
+    {
+        for (auto &t : t_max) t = far;
+    }
+};
+
 class hittable
 {
 public:
@@ -32,6 +48,22 @@ public:
 
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
 
+    /// Hit Packet
+    /// @details Finds the closest hit in (t_min, hits.t_max[n]) for every lane n set in lane_mask, updating hits. This default traces the
+    /// lanes one at a time; acceleration structures and primitives override it to test all lanes together with SIMD instructions.
+    virtual void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const
+    {
+        for (int lane = 0; lane < rays.size; lane++)
+        {
+            if (!(lane_mask >> lane & 1u)) continue;
+            if (hit(rays.lane_ray(lane), interval(t_min, hits.t_max[lane]), hits.rec[lane]))
+            {
+                hits.t_max[lane] = hits.rec[lane].t;
+                hits.hit_mask |= 1u << lane;
+            }
+        }
+    }
+
     virtual aabb bounding_box() const = 0;
 };
 
@@ -42,6 +42,12 @@ public:
         return hit_anything;
     }
 
+    void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const override
+    {
+        // Each object only sees the part of every lane still in front of the closest hit so far, through hits.t_max.
+        for (const auto &object : objects) { object->hit_packet(rays, t_min, lane_mask, hits); }
+    }
+
     aabb bounding_box() const override { return bbox; }
 
 private:
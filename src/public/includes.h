@@ -6,7 +6,9 @@
 #include <iostream>
 #include <limits>
 #include <memory>
-#include <random>
+
+// Project Includes
+#include "rng.h"
 
 // C++ STD Usings
 using std::fabs;
@@ -23,10 +25,8 @@ inline double degrees_to_radians(const double degrees) { return degrees * pi / 1
 
 inline double random_double()
 {
-    // Returns a random real number in [0, 1).
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937                           generator;
-    return distribution(generator);
+    // Returns a random real number in [0, 1) from the calling thread's generator.
+    return thread_rng().next_double();
 }
 
 inline double random_double(const double min, const double max)
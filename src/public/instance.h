@@ -0,0 +1,58 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <utility>
+
+#include "includes.h"
+
+#include "hittable.h"
+#include "transform.h"
+
+/// Instance
+/// @details One placement of a shared bottom-level structure (BLAS), typically a BVH over a model in its own object space. Rays are
+/// carried into object space by the inverse transform and traced against the shared structure, and the hit is carried back out, so any
+/// number of instances cost one copy of the model and its BVH. Put the instances in a top-level structure (TLAS), such as a bvh_node or
+/// a dynamic_bvh over them; moving an instance then only changes its own box, which the top level picks up with a refit.
+class instance final : public hittable
+{
+public:
+    instance(shared_ptr<hittable> object, const affine_transform &object_to_world)
+        : object(std::move(object))
+    {
+        set_transform(object_to_world);
+    }
+
+    /// Set Transform
+    /// @details Moves the instance. The top-level structure holding it must be refit before it is traced again.
+    void set_transform(const affine_transform &object_to_world)
+    {
+        to_world  = object_to_world;
+        to_object = object_to_world.inverse();
+        bbox      = to_world.apply_box(object->bounding_box());
+    }
+
+    bool hit(const ray &r, const interval ray_t, hit_record &rec) const override
+    {
+        // The direction is not renormalized, so a distance t along the object space ray is the same t along the world space one.
+        const ray object_ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()), r.time());
+
+        if (!object->hit(object_ray, ray_t, rec)) return false;
+
+        // Transforming a facing normal keeps it facing the transformed ray, so front_face carries over unchanged.
+        rec.p      = to_world.apply_point(rec.p);
+        rec.normal = unit_vector(to_object.apply_normal(rec.normal));
+        return true;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    const affine_transform &transform() const { return to_world; }
+
+private:
+    shared_ptr<hittable> object;
+    affine_transform     to_world;
+    affine_transform     to_object;
+    aabb                 bbox;
+};
+
+#endif
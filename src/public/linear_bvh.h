@@ -0,0 +1,83 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "includes.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "mapped_file.h"
+#include "traversal_stats.h"
+
+#include <span>
+#include <vector>
+
+/// Linear BVH Node
+/// @details One fixed-size node of a linear_bvh. Nodes are stored in depth-first order, so an interior node's first child always directly
+/// follows it, and only the second child needs an offset.
+struct linear_bvh_node
+{
+    aabb     bbox;
+    uint32_t offset;     // Leaf: index of the first primitive. Interior: index of the second child
+    uint16_t prim_count; // Number of primitives in a leaf; 0 for interior nodes
+    uint8_t  axis;       // Interior: axis along which the children are separated, which orders traversal
+    uint8_t  padding;
+};
+
+/// Hierarchy Depth
+/// @details Counts the interior nodes on the longest path from the root of a depth-first array of linear_bvh_node to a leaf. Traversal
+/// pushes one child per interior node it descends through, so this is the most entries its stack ever holds.
+int hierarchy_depth(std::span<const linear_bvh_node> nodes);
+
+/// Linear Bounding Volume Hierarchy
+/// @details A bvh_node tree compacted into one contiguous, depth-first array of linear_bvh_node, with the primitives gathered into one array
+/// in leaf order. Traversal is a loop over node indices with an explicit stack rather than recursive virtual calls through heap-allocated
+/// nodes, so descending the tree costs no pointer chasing or virtual dispatch. The nearer child, judged by the ray direction along the split
+/// axis, is visited first, and the ray interval shrinks to the closest hit so far, so far subtrees are skipped.
+class linear_bvh final : public hittable
+{
+public:
+    /// @details Builds a bvh_node hierarchy over the list, then compacts it.
+    explicit linear_bvh(const hittable_list &list, const bvh_build_options &options = {});
+
+    /// @details Compacts an already built bvh_node hierarchy.
+    explicit linear_bvh(const bvh_node &root);
+
+    /// @details Traverses nodes that live inside a mapped file, such as a BVH cache (see bvh_cache.h), without copying them. The mapping
+    /// is kept open for as long as the hierarchy exists.
+    ///
+    /// Every constructor rejects, and reports, a hierarchy deeper than the traversal stack, leaving this one empty.
+    linear_bvh(shared_ptr<const mapped_file> mapping, std::span<const linear_bvh_node> mapped_nodes, std::vector<shared_ptr<hittable> > primitives);
+
+    linear_bvh(const linear_bvh &) = delete;
+
+    linear_bvh &operator=(const linear_bvh &) = delete;
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+
+    void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const override;
+
+    aabb bounding_box() const override;
+
+    std::span<const linear_bvh_node> node_array() const { return nodes; }
+
+    const std::vector<shared_ptr<hittable> > &primitive_array() const { return primitives; }
+
+private:
+    static constexpr int traversal_stack_size = 128; // Deepest tree the traversal stack can hold
+
+    std::vector<linear_bvh_node>       node_storage; // Nodes built in memory; empty when they are mapped from a file
+    shared_ptr<const mapped_file>      mapping;      // File the nodes are mapped from, if any
+    std::span<const linear_bvh_node>   nodes;        // The nodes traversed, in node_storage or in the mapping
+    std::vector<shared_ptr<hittable> > primitives;
+
+    uint32_t flatten(const bvh_node &node);
+
+    uint32_t add_leaf(const aabb &bbox, const std::vector<shared_ptr<hittable> > &leaf_primitives);
+
+    /// @details Empties a hierarchy too deep for the traversal stack, and reports it.
+    void check_depth();
+};
+
+#endif
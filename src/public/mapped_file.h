@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/// Mapped File
+/// @details A read-only memory mapping of a whole file. Opening one costs no reads: the operating system pages the contents in on first
+/// touch and may share them with other processes mapping the same file, so large files are usable as soon as they are mapped.
+class mapped_file
+{
+public:
+    /// @details Maps the file at path. If the file can't be opened or mapped, or is empty, the mapping is left closed; check is_open.
+    explicit mapped_file(const std::string &path);
+
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool is_open() const { return bytes != nullptr; }
+
+    const unsigned char *data() const { return bytes; }
+
+    size_t size() const { return length; }
+
+private:
+    const unsigned char *bytes  = nullptr;
+    size_t               length = 0;
+
+#if defined(_WIN32)
+    void *file_handle    = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+#endif
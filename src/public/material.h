@@ -7,12 +7,25 @@
 
 class hit_record;
 
+/// Material Type
+/// @details Identifies the concrete class of a material, so that batched shading can group hits by material and call each scatter directly
+/// instead of through the virtual table.
+enum class material_type
+{
+    other,
+    lambertian,
+    metal,
+    dielectric,
+};
+
 class material
 {
 public:
     virtual ~material() = default;
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const;
+
+    virtual material_type type() const;
 };
 
 class lambertian final : public material
@@ -24,6 +37,8 @@ public:
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override;
 
+    material_type type() const override;
+
 private:
     color               albedo;
     shared_ptr<texture> tex;
@@ -36,6 +51,8 @@ public:
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override;
 
+    material_type type() const override;
+
 private:
     color  albedo;
     double fuzz;
@@ -48,6 +65,8 @@ public:
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override;
 
+    material_type type() const override;
+
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over
     // the refractive index of the enclosing media
@@ -0,0 +1,34 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "includes.h"
+
+#include "triangle_mesh.h"
+
+#include <string>
+
+/// Load OBJ
+/// @details Reads the positions, texture coordinates, normals and faces of a Wavefront OBJ file into mesh buffers. The file is memory
+/// mapped and cut into chunks at line breaks, and the chunks are parsed in parallel straight from the mapping, with no per-line strings:
+/// one pass counts what each chunk holds, so that a second can write every chunk into its own slice of the final arrays. Faces with more
+/// than three corners are split into fans of triangles. OBJ indexes positions, texture coordinates and normals separately, so a position
+/// used with different attributes by different corners becomes one vertex per combination.
+/// @param thread_count Parsing threads, resolved through worker_count.
+/// @return The mesh, or nullptr if the file can't be read or is malformed.
+shared_ptr<mesh_buffers> load_obj(const std::string &path, int thread_count = 0);
+
+/// Load PLY
+/// @details Reads the vertex positions, and normals and texture coordinates where present, and the faces of a binary PLY file of either
+/// byte order into mesh buffers. The file is memory mapped, and the fixed-size vertex records are decoded in parallel chunks. Faces are
+/// decoded in parallel too when every one is a triangle, which is checked in the same pass; otherwise they are walked once in order and
+/// split into fans of triangles.
+/// @param thread_count Decoding threads, resolved through worker_count.
+/// @return The mesh, or nullptr if the file can't be read, is ASCII PLY, or is malformed.
+shared_ptr<mesh_buffers> load_ply(const std::string &path, int thread_count = 0);
+
+/// Load Mesh
+/// @details Loads an OBJ or PLY file, chosen by its extension, and logs its size, load time and throughput.
+/// @return The mesh, or nullptr if the file can't be loaded.
+shared_ptr<mesh_buffers> load_mesh(const std::string &path, int thread_count = 0);
+
+#endif
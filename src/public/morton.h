@@ -0,0 +1,21 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+
+/// Spread Bits
+/// @details One axis of a 63-bit Morton (Z-order) code: interleaving three spread cells, shifted by 2, 1 and 0, orders points along the
+/// Morton curve. Shared by the BVH and compressed mesh builders, so both sort by the same code.
+/// @return v's low 21 bits, spread out so two zero bits follow each one.
+inline uint64_t spread_bits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+#endif
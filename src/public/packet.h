@@ -0,0 +1,42 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "ray.h"
+
+#include <cstdint>
+
+/// Largest number of rays in one ray_packet.
+constexpr int max_packet_size = 16;
+
+/// Ray Packet
+/// @details A group of up to max_packet_size rays, stored as one array per component (structure of arrays), so that four lanes at a time can
+/// be loaded straight into f64x4 registers. Packets are meant for coherent rays, such as the camera rays of neighboring samples, which tend
+/// to visit the same bounding boxes. The reciprocal direction is precomputed for slab tests.
+struct ray_packet
+{
+    int size = 0; // Lanes in use, rounded up to a multiple of 4; unused lanes are masked off by callers
+
+    alignas(32) double origin[3][max_packet_size];
+    alignas(32) double direction[3][max_packet_size];
+    alignas(32) double inv_direction[3][max_packet_size];
+    alignas(32) double time[max_packet_size];
+
+    void set(const int lane, const ray &r)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            origin[axis][lane]        = r.origin()[axis];
+            direction[axis][lane]     = r.direction()[axis];
+            inv_direction[axis][lane] = 1.0 / r.direction()[axis];
+        }
+        time[lane] = r.time();
+    }
+
+    ray lane_ray(const int lane) const
+    {
+        return {point3(origin[0][lane], origin[1][lane], origin[2][lane]), vec3(direction[0][lane], direction[1][lane], direction[2][lane]),
+                time[lane]};
+    }
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/// Worker Thread Count
+/// @details Resolves a requested thread count into the number of workers to launch.
+/// @param requested The requested number of threads. Values of 0 or less select every hardware thread.
+/// @return The number of worker threads to use, which is always at least 1.
+inline int worker_count(const int requested)
+{
+    if (requested > 0) return requested;
+
+    const auto hardware_threads = static_cast<int>(std::thread::hardware_concurrency());
+    return hardware_threads > 0 ? hardware_threads : 1;
+}
+
+/// Parallel For
+/// @details Calls body(index) once for every index in [0, count), spread across a pool of worker threads. Workers pull the next
+/// index from a shared atomic counter, so work items of uneven cost (such as image tiles) balance themselves across the pool. The
+/// calling thread joins in as one of the workers, and the call returns once every index has been processed.
+/// @param count The number of work items.
+/// @param thread_count The requested number of threads, resolved through worker_count.
+/// @param body A callable accepting a size_t work item index. It may be invoked concurrently from several threads.
+template<typename Body>
+void parallel_for(const size_t count, const int thread_count, const Body &body)
+{
+    std::atomic<size_t> next_index(0);
+
+    const auto worker = [&]
+    {
+        for (size_t index = next_index++; index < count; index = next_index++) { body(index); }
+    };
+
+    const auto               workers = static_cast<size_t>(worker_count(thread_count));
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+
+    for (size_t t = 1; t < workers && t < count; t++) { pool.emplace_back(worker); }
+
+    worker();
+
+    for (auto &thread : pool) { thread.join(); }
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/// Random Number Generator
+/// @details A PCG32 (permuted congruential) generator. The whole state is two 64-bit words, so it is cheap to keep one per thread,
+/// cheap to copy, and cheap to reseed for every pixel sample. Each output is a 64-bit LCG step followed by an xorshift and a
+/// random rotation, which passes statistical test suites that the raw LCG fails.
+class rng
+{
+public:
+    rng() : rng(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+
+    /// @details Seeds the generator. Generators that share a seed but use different streams produce unrelated sequences.
+    rng(const uint64_t seed, const uint64_t stream) { reseed(seed, stream); }
+
+    void reseed(const uint64_t seed, const uint64_t stream)
+    {
+        state = 0;
+        inc   = (stream << 1u) | 1u;
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    /// @return A uniformly distributed 32-bit unsigned integer.
+    uint32_t next_uint()
+    {
+        const uint64_t old_state = state;
+        state                    = old_state * 6364136223846793005ULL + inc;
+
+        const auto xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        const auto rotation   = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31u));
+    }
+
+    /// @return A uniformly distributed real number in [0, 1).
+    double next_double() { return next_uint() * 0x1.0p-32; }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+/// Mix Seed
+/// @details The SplitMix64 finalizer. Scrambles a 64-bit value so that nearby inputs, such as neighboring pixel indices, give
+/// unrelated seeds.
+inline uint64_t mix_seed(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27u)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31u);
+}
+
+/// Thread RNG
+/// @return The calling thread's generator. Every thread starts from the same default seed; renderers reseed it per sample.
+inline rng &thread_rng()
+{
+    thread_local rng generator;
+    return generator;
+}
+
+#endif
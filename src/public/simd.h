@@ -0,0 +1,132 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+/// 4-Wide Double Vector
+/// @details Four doubles processed together. With AVX enabled (see the LEARNRT_AVX2 build option) every operation is a single
+/// 256-bit instruction; otherwise each one falls back to a plain loop over the four lanes. Comparisons return a lane mask in the same
+/// type, with every bit of a lane set where the comparison holds, which select, any and movemask consume.
+struct f64x4
+{
+#if defined(__AVX__)
+    __m256d v;
+
+    static f64x4 load(const double *p) { return {_mm256_loadu_pd(p)}; }
+
+    static f64x4 broadcast(const double x) { return {_mm256_set1_pd(x)}; }
+
+    void store(double *p) const { _mm256_storeu_pd(p, v); }
+
+    /// @return A 4-bit integer holding the sign bit of each lane, lane 0 in bit 0. For lane masks, this is the set of true lanes.
+    int movemask() const { return _mm256_movemask_pd(v); }
+#else
+    double v[4];
+
+    static f64x4 load(const double *p) { return {{p[0], p[1], p[2], p[3]}}; }
+
+    static f64x4 broadcast(const double x) { return {{x, x, x, x}}; }
+
+    void store(double *p) const
+    {
+        for (int lane = 0; lane < 4; lane++) p[lane] = v[lane];
+    }
+
+    int movemask() const
+    {
+        int mask = 0;
+        for (int lane = 0; lane < 4; lane++) mask |= static_cast<int>(std::bit_cast<uint64_t>(v[lane]) >> 63) << lane;
+        return mask;
+    }
+#endif
+};
+
+#if defined(__AVX__)
+inline f64x4 operator+(const f64x4 a, const f64x4 b) { return {_mm256_add_pd(a.v, b.v)}; }
+
+inline f64x4 operator-(const f64x4 a, const f64x4 b) { return {_mm256_sub_pd(a.v, b.v)}; }
+
+inline f64x4 operator*(const f64x4 a, const f64x4 b) { return {_mm256_mul_pd(a.v, b.v)}; }
+
+inline f64x4 operator/(const f64x4 a, const f64x4 b) { return {_mm256_div_pd(a.v, b.v)}; }
+
+inline f64x4 operator&(const f64x4 a, const f64x4 b) { return {_mm256_and_pd(a.v, b.v)}; }
+
+inline f64x4 operator|(const f64x4 a, const f64x4 b) { return {_mm256_or_pd(a.v, b.v)}; }
+
+inline f64x4 operator<(const f64x4 a, const f64x4 b) { return {_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)}; }
+
+inline f64x4 operator>(const f64x4 a, const f64x4 b) { return {_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ)}; }
+
+inline f64x4 operator>=(const f64x4 a, const f64x4 b) { return {_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ)}; }
+
+inline f64x4 min(const f64x4 a, const f64x4 b) { return {_mm256_min_pd(a.v, b.v)}; }
+
+inline f64x4 max(const f64x4 a, const f64x4 b) { return {_mm256_max_pd(a.v, b.v)}; }
+
+inline f64x4 sqrt(const f64x4 a) { return {_mm256_sqrt_pd(a.v)}; }
+
+/// @return Lanes of a where mask is set, and lanes of b elsewhere.
+inline f64x4 select(const f64x4 mask, const f64x4 a, const f64x4 b) { return {_mm256_blendv_pd(b.v, a.v, mask.v)}; }
+#else
+namespace simd_detail
+{
+    template<typename Op>
+    f64x4 lanewise(const f64x4 a, const f64x4 b, const Op op)
+    {
+        f64x4 result;
+        for (int lane = 0; lane < 4; lane++) result.v[lane] = op(a.v[lane], b.v[lane]);
+        return result;
+    }
+
+    inline double lane_mask(const bool set) { return std::bit_cast<double>(set ? ~uint64_t(0) : uint64_t(0)); }
+
+    inline uint64_t bits(const double x) { return std::bit_cast<uint64_t>(x); }
+}
+
+inline f64x4 operator+(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x + y; }); }
+
+inline f64x4 operator-(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x - y; }); }
+
+inline f64x4 operator*(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x * y; }); }
+
+inline f64x4 operator/(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x / y; }); }
+
+inline f64x4 operator&(const f64x4 a, const f64x4 b)
+{
+    return simd_detail::lanewise(a, b, [](double x, double y) { return std::bit_cast<double>(simd_detail::bits(x) & simd_detail::bits(y)); });
+}
+
+inline f64x4 operator|(const f64x4 a, const f64x4 b)
+{
+    return simd_detail::lanewise(a, b, [](double x, double y) { return std::bit_cast<double>(simd_detail::bits(x) | simd_detail::bits(y)); });
+}
+
+inline f64x4 operator<(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return simd_detail::lane_mask(x < y); }); }
+
+inline f64x4 operator>(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return simd_detail::lane_mask(x > y); }); }
+
+inline f64x4 operator>=(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return simd_detail::lane_mask(x >= y); }); }
+
+// Like the SSE/AVX instructions, return the second operand when either is NaN.
+inline f64x4 min(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x < y ? x : y; }); }
+
+inline f64x4 max(const f64x4 a, const f64x4 b) { return simd_detail::lanewise(a, b, [](double x, double y) { return x > y ? x : y; }); }
+
+inline f64x4 sqrt(const f64x4 a) { return simd_detail::lanewise(a, a, [](double x, double) { return std::sqrt(x); }); }
+
+inline f64x4 select(const f64x4 mask, const f64x4 a, const f64x4 b)
+{
+    f64x4 result;
+    for (int lane = 0; lane < 4; lane++) result.v[lane] = (simd_detail::bits(mask.v[lane]) >> 63) ? a.v[lane] : b.v[lane];
+    return result;
+}
+#endif
+
+#endif
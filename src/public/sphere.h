@@ -5,6 +5,8 @@
 
 #include "includes.h"
 
+#include "simd.h"
+
 class sphere final : public hittable
 {
 public:
@@ -34,6 +36,19 @@ public:
         center_vec = center2 - center1;
     }
 
+    /// Move
+    /// @details Places the sphere for a new frame of an animation: it moves from center1 at time 0 to center2 at time 1, or stays put when
+    /// the two are equal. The bounding box follows, so any BVH holding the sphere must be refit before it is traced again.
+    void move(const point3 &new_center1, const point3 &new_center2)
+    {
+        center1    = new_center1;
+        center_vec = new_center2 - new_center1;
+        is_moving  = center_vec.length_squared() > 0;
+
+        const auto radii_vec = vec3(radius, radius, radius);
+        bbox                 = aabb(aabb(new_center1 - radii_vec, new_center1 + radii_vec), aabb(new_center2 - radii_vec, new_center2 + radii_vec));
+    }
+
     bool hit(const ray &r, const interval ray_t, hit_record &rec) const override
     {
         const point3 center = is_moving ? sphere_center(r.time()) : center1;
@@ -55,19 +70,73 @@ public:
             if (!ray_t.surrounds(root)) { return false; }
         }
 
-        rec.t                     = root;
-        rec.p                     = r.at(rec.t);
-        const vec3 outward_normal = (rec.p - center1) / radius;
-        rec.set_face_normal(r, outward_normal);
-        get_sphere_uv(outward_normal, rec.u, rec.v);
-        rec.mat = mat;
+        set_hit_record(r, root, rec);
 
         return true;
     }
 
+    void hit_packet(const ray_packet &rays, const double t_min, const uint32_t lane_mask, packet_hit &hits) const override
+    {
+        const f64x4 radius_squared = f64x4::broadcast(radius * radius);
+        const f64x4 t_lower        = f64x4::broadcast(t_min);
+
+        for (int base = 0; base < rays.size; base += 4)
+        {
+            const uint32_t lanes = lane_mask >> base & 0xFu;
+            if (lanes == 0) continue;
+
+            // Same quadratic as hit, for four rays at once.
+            f64x4 center[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                center[axis] = f64x4::broadcast(center1[axis]);
+                if (is_moving) center[axis] = center[axis] + f64x4::load(rays.time + base) * f64x4::broadcast(center_vec[axis]);
+            }
+
+            const f64x4 dx = f64x4::load(rays.direction[0] + base);
+            const f64x4 dy = f64x4::load(rays.direction[1] + base);
+            const f64x4 dz = f64x4::load(rays.direction[2] + base);
+            const f64x4 ox = center[0] - f64x4::load(rays.origin[0] + base);
+            const f64x4 oy = center[1] - f64x4::load(rays.origin[1] + base);
+            const f64x4 oz = center[2] - f64x4::load(rays.origin[2] + base);
+
+            const f64x4 a = dx * dx + dy * dy + dz * dz;
+            const f64x4 h = dx * ox + dy * oy + dz * oz;
+            const f64x4 c = ox * ox + oy * oy + oz * oz - radius_squared;
+
+            const f64x4 discriminant = h * h - a * c;
+            const f64x4 sqrtd        = sqrt(max(discriminant, f64x4::broadcast(0.0)));
+            const f64x4 t_upper      = f64x4::load(hits.t_max + base);
+
+            const f64x4 near_root = (h - sqrtd) / a;
+            const f64x4 far_root  = (h + sqrtd) / a;
+            const f64x4 near_ok   = (near_root > t_lower) & (near_root < t_upper);
+            const f64x4 far_ok    = (far_root > t_lower) & (far_root < t_upper);
+            const f64x4 hit_lanes = (discriminant >= f64x4::broadcast(0.0)) & (near_ok | far_ok);
+
+            uint32_t hit_mask = static_cast<uint32_t>(hit_lanes.movemask()) & lanes;
+            if (hit_mask == 0) continue;
+
+            alignas(32) double roots[4];
+            select(near_ok, near_root, far_root).store(roots);
+
+            for (; hit_mask != 0; hit_mask &= hit_mask - 1)
+            {
+                const int lane_offset = std::countr_zero(hit_mask);
+                const int lane        = base + lane_offset;
+
+                set_hit_record(rays.lane_ray(lane), roots[lane_offset], hits.rec[lane]);
+                hits.t_max[lane] = roots[lane_offset];
+                hits.hit_mask |= 1u << lane;
+            }
+        }
+    }
+
     aabb bounding_box() const override { return bbox; }
 
 private:
+    friend class sphere_batch;
+
     shared_ptr<material> mat;
     point3               center1;
     double               radius;
@@ -75,6 +144,16 @@ private:
     bool                 is_moving;
     aabb                 bbox;
 
+    void set_hit_record(const ray &r, const double root, hit_record &rec) const
+    {
+        rec.t                     = root;
+        rec.p                     = r.at(rec.t);
+        const vec3 outward_normal = (rec.p - center1) / radius;
+        rec.set_face_normal(r, outward_normal);
+        get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.mat = mat.get();
+    }
+
     point3 sphere_center(const double time) const
     {
         // Linearly interpolate from center1 to center2 according to time, where t=0 yields
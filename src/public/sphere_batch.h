@@ -0,0 +1,48 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include "includes.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+
+#include <vector>
+
+/// Sphere Batch
+/// @details Up to max_size spheres packed into one primitive. Centers, motion vectors and radii are stored structure-of-arrays, one row
+/// of max_size doubles per coordinate, and each sphere refers to its material by a small index into the batch's own material table. A
+/// ray is tested against four spheres per f64x4 operation, and the closest root wins, so a BVH leaf holding one batch does the work of
+/// max_size sphere::hit calls in a couple of SIMD passes and one virtual call. Hits are the same as the spheres' own.
+class sphere_batch final : public hittable
+{
+public:
+    static constexpr int max_size = 8; // Most spheres one batch holds: two groups of four lanes
+
+    /// @details Packs the first count spheres of the array, at most max_size of them.
+    sphere_batch(const sphere *const *spheres, int count);
+
+    /// Pack
+    /// @details Replaces the spheres of list by batches of up to batch_size neighboring spheres, taken from the leaves of an SAH hierarchy
+    /// so that each batch is spatially compact. Other objects, and spheres left on their own, are kept as they are.
+    /// @return The new list, to build a BVH over in place of list.
+    static hittable_list pack(const hittable_list &list, int batch_size = max_size);
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+
+    aabb bounding_box() const override { return bbox; }
+
+    int size() const { return count; }
+
+private:
+    alignas(32) double center[3][max_size]; // Center at time 0, per axis
+    alignas(32) double motion[3][max_size]; // Offset from the time 0 center to the time 1 center, per axis; zero for stationary spheres
+    alignas(32) double radius[max_size];
+    uint8_t            material_index[max_size]; // Index into materials of each sphere's material
+
+    std::vector<shared_ptr<material> > materials;
+    int                                count = 0;
+    aabb                               bbox  = aabb::empty;
+};
+
+#endif
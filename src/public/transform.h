@@ -0,0 +1,127 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "includes.h"
+
+#include "aabb.h"
+
+/// Affine Transform
+/// @details A linear map followed by a translation, p -> m p + offset, used to place instances in the world. Transforms compose with *,
+/// right to left: (a * b) applies b first, then a.
+class affine_transform
+{
+public:
+    /// @details The identity transform.
+    affine_transform() = default;
+
+    static affine_transform translation(const vec3 &offset)
+    {
+        affine_transform transform;
+        transform.offset = offset;
+        return transform;
+    }
+
+    static affine_transform scaling(const double factor) { return scaling(vec3(factor, factor, factor)); }
+
+    static affine_transform scaling(const vec3 &factors)
+    {
+        affine_transform transform;
+        for (int row = 0; row < 3; row++) transform.m[row][row] = factors[row];
+        return transform;
+    }
+
+    /// @details Rotation by degrees counterclockwise about axis, looking down the axis towards the origin.
+    static affine_transform rotation(const vec3 &axis, const double degrees)
+    {
+        const vec3   a = unit_vector(axis);
+        const double c = std::cos(degrees_to_radians(degrees));
+        const double s = std::sin(degrees_to_radians(degrees));
+
+        affine_transform transform;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++) transform.m[row][col] = (1 - c) * a[row] * a[col] + (row == col ? c : 0);
+        }
+        transform.m[0][1] -= s * a[2];
+        transform.m[0][2] += s * a[1];
+        transform.m[1][0] += s * a[2];
+        transform.m[1][2] -= s * a[0];
+        transform.m[2][0] -= s * a[1];
+        transform.m[2][1] += s * a[0];
+        return transform;
+    }
+
+    affine_transform operator*(const affine_transform &b) const
+    {
+        affine_transform product;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++) product.m[row][col] = m[row][0] * b.m[0][col] + m[row][1] * b.m[1][col] + m[row][2] * b.m[2][col];
+        }
+        product.offset = apply_point(b.offset);
+        return product;
+    }
+
+    /// @return The inverse transform. The linear part must not be singular.
+    affine_transform inverse() const
+    {
+        affine_transform result;
+
+        // Adjugate over determinant.
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                const int r0 = (col + 1) % 3, r1 = (col + 2) % 3;
+                const int c0 = (row + 1) % 3, c1 = (row + 2) % 3;
+                result.m[row][col] = m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+            }
+        }
+
+        const double determinant = m[0][0] * result.m[0][0] + m[0][1] * result.m[1][0] + m[0][2] * result.m[2][0];
+        for (auto &row : result.m)
+        {
+            for (double &value : row) value /= determinant;
+        }
+
+        result.offset = -result.apply_vector(offset);
+        return result;
+    }
+
+    point3 apply_point(const point3 &p) const { return apply_vector(p) + offset; }
+
+    vec3 apply_vector(const vec3 &v) const
+    {
+        return {m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2], m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]};
+    }
+
+    /// Apply Normal
+    /// @details Surface normals don't transform like directions under non-uniform scaling; they take the inverse transpose of the linear
+    /// part. Call this on the inverse of the transform that moves the surface.
+    /// @return The transposed linear part applied to n, not renormalized.
+    vec3 apply_normal(const vec3 &n) const
+    {
+        return {m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2], m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2],
+                m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2]};
+    }
+
+    /// @return The box around all eight transformed corners of box.
+    aabb apply_box(const aabb &box) const
+    {
+        aabb result = aabb::empty;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const point3 p(corner & 1 ? box.x.max : box.x.min, corner & 2 ? box.y.max : box.y.min, corner & 4 ? box.z.max : box.z.min);
+            const point3 q = apply_point(p);
+            result         = aabb(result, aabb(q, q));
+        }
+        return result;
+    }
+
+private:
+    double m[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    vec3   offset  = vec3(0, 0, 0);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TRAVERSAL_STATS_H
+#define TRAVERSAL_STATS_H
+
+#include <cstdint>
+
+/// Traversal Statistics
+/// @details Running counts of the work done by acceleration structure traversal. Each thread counts into its own copy, so counting costs
+/// one increment and needs no synchronization; callers read or reset the calling thread's counters around the work they want to measure.
+struct traversal_stats
+{
+    uint64_t rays            = 0; // Rays the camera traced into the scene
+    uint64_t node_visits     = 0; // BVH nodes whose bounding box was tested
+    uint64_t primitive_tests = 0; // Objects tested for a hit in BVH leaves
+
+    traversal_stats &operator+=(const traversal_stats &other)
+    {
+        rays += other.rays;
+        node_visits += other.node_visits;
+        primitive_tests += other.primitive_tests;
+        return *this;
+    }
+
+    traversal_stats operator-(const traversal_stats &other) const
+    {
+        return {rays - other.rays, node_visits - other.node_visits, primitive_tests - other.primitive_tests};
+    }
+};
+
+/// @return The calling thread's traversal counters.
+inline traversal_stats &thread_traversal_stats()
+{
+    thread_local traversal_stats stats;
+    return stats;
+}
+
+#endif
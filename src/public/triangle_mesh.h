@@ -0,0 +1,163 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "includes.h"
+
+#include "bvh.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "simd.h"
+
+#include <vector>
+
+/// Mesh Buffers
+/// @details The vertex and index buffers of an indexed triangle mesh. Triangle n is made of the vertices indices[3n], indices[3n + 1] and
+/// indices[3n + 2], listed counterclockwise as seen from the front. Normals and texture coordinates are optional: without normals the
+/// mesh is flat shaded, and without texture coordinates a hit's u, v are its barycentric coordinates in the triangle.
+struct mesh_buffers
+{
+    std::vector<point3>   positions;
+    std::vector<vec3>     normals;   // One per position, or none
+    std::vector<double>   uvs;       // A u, v pair per position, or none
+    std::vector<uint32_t> indices;   // Three per triangle
+
+    size_t triangle_count() const { return indices.size() / 3; }
+
+    size_t memory_bytes() const
+    {
+        return sizeof(point3) * positions.size() + sizeof(vec3) * normals.size() + sizeof(double) * uvs.size()
+               + sizeof(uint32_t) * indices.size();
+    }
+};
+
+/// Intersect Triangle
+/// @details Möller-Trumbore ray and triangle intersection. Defined inline, since mesh traversal loops call it for every triangle.
+/// @return True if r crosses the triangle p0, p1, p2 inside ray_t, with t set to the distance and b1, b2 to the barycentric weights of p1
+/// and p2.
+inline bool intersect_triangle(const point3 &p0, const point3 &p1, const point3 &p2, const ray &r, const interval &ray_t, double &t,
+                               double &b1, double &b2)
+{
+    const vec3 edge1 = p1 - p0;
+    const vec3 edge2 = p2 - p0;
+
+    // A ray parallel to the triangle's plane, or a degenerate triangle, has a determinant of zero.
+    const vec3   pvec = cross(r.direction(), edge2);
+    const double det  = dot(edge1, pvec);
+    if (std::fabs(det) < 1e-12) return false;
+
+    const double inv_det = 1.0 / det;
+    const vec3   tvec    = r.origin() - p0;
+
+    b1 = dot(tvec, pvec) * inv_det;
+    if (b1 < 0 || b1 > 1) return false;
+
+    const vec3 qvec = cross(tvec, edge1);
+    b2              = dot(r.direction(), qvec) * inv_det;
+    if (b2 < 0 || b1 + b2 > 1) return false;
+
+    t = dot(edge2, qvec) * inv_det;
+    return ray_t.surrounds(t);
+}
+
+/// Triangle Leaf Layout
+/// @details How a triangle_mesh stores the triangles of its leaves, trading memory for intersection speed.
+enum class triangle_leaf_layout
+{
+    indexed, // Leaves list triangle indices, four bytes per triangle, and each triangle is read from the buffers and tested on its own
+    packed4, // Leaves of up to four triangles, copied out structure-of-arrays and tested together, 80 bytes per triangle
+    packed8, // As packed4, with leaves of up to eight triangles in two packets: fewer nodes, more wasted lanes in small leaves
+};
+
+/// Triangle Mesh
+/// @details A hittable made of every triangle of a set of mesh_buffers, which several meshes may share. The triangles are not hittables of
+/// their own: the mesh builds a binned SAH hierarchy over their indices alone, stored as a depth-first array of linear_bvh_node whose
+/// leaves point into an array of triangle indices, and traverses it like linear_bvh. Each triangle costs four bytes in the hierarchy
+/// rather than a heap object behind a shared pointer. Triangles are tested with the Möller-Trumbore algorithm, and hits carry normals and
+/// texture coordinates interpolated from the triangle's vertices.
+///
+/// With a packed layout, the leaves hold copies of their triangles' vertices in triangle_packet form instead, four triangles to a packet,
+/// and every packet is tested against the ray with one watertight intersection test in f64x4 lanes. Packed leaves skip the index and
+/// position lookups of the indexed layout and make fewer, larger leaves worth their cost, at twenty times the memory per triangle.
+class triangle_mesh final : public hittable
+{
+public:
+    /// @details Checks the buffers and builds the hierarchy with options. Buffers that don't describe a valid mesh are reported and leave
+    /// it empty.
+    /// With a packed layout, leaves hold up to four or eight triangles whatever options.max_leaf_size says, and options.intersection_cost
+    /// is divided by the four triangles a packet tests at once.
+    triangle_mesh(shared_ptr<const mesh_buffers> buffers, shared_ptr<material> mat, const bvh_build_options &options = {},
+                  triangle_leaf_layout layout = triangle_leaf_layout::indexed);
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+
+    aabb bounding_box() const override { return bbox; }
+
+    const mesh_buffers &buffer_data() const { return *buffers; }
+
+    std::span<const linear_bvh_node> node_array() const { return nodes; }
+
+    triangle_leaf_layout leaf_layout() const { return layout; }
+
+    /// @return The bytes taken by the hierarchy and its leaves, not counting the shared buffers.
+    size_t memory_bytes() const;
+
+private:
+    static constexpr int traversal_stack_size = 128; // Deepest tree the traversal stack can hold
+
+    /// A triangle while the hierarchy is built.
+    struct triangle_ref
+    {
+        aabb     box;
+        point3   centroid;
+        uint32_t triangle;
+    };
+
+    /// Four triangles of a packed leaf, structure-of-arrays: vertex[v][axis][lane] is coordinate axis of vertex v of the triangle in
+    /// lane. Lanes past the end of a leaf are zero, and are masked out of the test.
+    struct triangle_packet
+    {
+        alignas(32) double vertex[3][3][4];
+        uint32_t           triangle[4]; // Index of the triangle in each lane
+    };
+
+    /// A ray in the space of the watertight test, see hit_triangle_packet.
+    struct sheared_ray;
+
+    shared_ptr<const mesh_buffers> buffers;
+    shared_ptr<material>           mat;
+    triangle_leaf_layout           layout;
+    std::vector<linear_bvh_node>   nodes;
+    std::vector<uint32_t>          triangles; // Triangle indices in leaf order; indexed layout only
+    std::vector<triangle_packet>   packets;   // Packed leaves in leaf order: leaf offsets count packets, and prim_count triangles
+    aabb                           bbox = aabb::empty;
+
+    /// Build Node
+    /// @details Builds the subtree over refs[start, end), splitting each node at the cheapest of options.sah_bins bucket boundaries
+    /// along the longest centroid axis, and appends its nodes depth-first.
+    /// @return The index of the subtree's root.
+    uint32_t build_node(std::vector<triangle_ref> &refs, size_t start, size_t end, const bvh_build_options &options);
+
+    uint32_t add_leaf(const std::vector<triangle_ref> &refs, size_t start, size_t end, const aabb &box);
+
+    /// Pack Leaves
+    /// @details Copies the triangles of every leaf into packets and points the leaves at them instead of at the triangle indices, which
+    /// are then freed.
+    void pack_leaves();
+
+    /// Hit Triangle
+    /// @details intersect_triangle for one triangle of the buffers.
+    bool hit_triangle(uint32_t triangle, const ray &r, const interval &ray_t, double &t, double &b1, double &b2) const;
+
+    /// Hit Triangle Packet
+    /// @details Watertight ray and triangle intersection (Woop, Benthin and Wald 2013) against the first lane_count triangles of packet
+    /// at once. The vertices are moved into a space where the ray starts at the origin and runs along +z, and a triangle is hit where the
+    /// signed areas it makes with the z axis, edge by edge, agree in sign. Neighboring triangles compute the areas of a shared edge
+    /// from the same vertices, so a ray through the edge can't slip between them.
+    /// @return True if r crosses one of the triangles inside ray_t, with t, b1, b2 and triangle set for the closest as by hit_triangle.
+    static bool hit_triangle_packet(const triangle_packet &packet, int lane_count, const sheared_ray &r, const interval &ray_t,
+                                    double &t, double &b1, double &b2, uint32_t &triangle);
+
+    void set_hit_record(uint32_t triangle, const ray &r, double t, double b1, double b2, hit_record &rec) const;
+};
+
+#endif
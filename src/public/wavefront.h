@@ -0,0 +1,85 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "includes.h"
+
+#include "hittable.h"
+#include "material.h"
+
+#include <vector>
+
+class camera;
+
+/// Path Request
+/// @details One camera sample to trace: pixel i, j, and the sample's index within that pixel, which selects its random number stream.
+struct path_request
+{
+    int i;
+    int j;
+    int sample;
+};
+
+/// Wavefront Path Tracer
+/// @details A breadth-first alternative to camera::ray_color. Instead of following one path through every bounce before starting the next,
+/// it advances a whole batch of paths one bounce at a time, in stages:\n
+/// 1. Generate: create a camera ray for every requested sample.\n
+/// 2. Intersect: find the closest hit of every active path.\n
+/// 3. Sort: bucket the hits by material type with a counting sort.\n
+/// 4. Shade: scatter each bucket in turn, calling the concrete material's scatter directly, and apply Russian roulette.\n
+/// Path state is kept in structure-of-arrays form, and each stage runs one tight loop over it. The scene is walked for many rays in a row
+/// and each material's code and data stay hot while its bucket is shaded. Every path keeps its own random number generator, so the result
+/// is bit-for-bit the same as tracing the same samples depth-first.
+class wavefront_integrator
+{
+public:
+    /// @param cam The camera that generates rays and provides max_depth, rr_min_depth and the background.
+    /// @param batch_size The most paths kept in flight at once. Longer request lists are traced in consecutive batches.
+    explicit wavefront_integrator(const camera &cam, size_t batch_size = 1 << 14);
+
+    /// Trace
+    /// @details Traces one path for every request.
+    /// @param results Resized to requests.size() and filled with the color of each path, in request order.
+    void trace(const hittable &world, const std::vector<path_request> &requests, std::vector<color> &results);
+
+private:
+    const camera &cam;
+    size_t        batch_size;
+
+    // Per-path state, structure-of-arrays
+    std::vector<double>     origin_x, origin_y, origin_z;
+    std::vector<double>     direction_x, direction_y, direction_z;
+    std::vector<double>     time;
+    std::vector<double>     throughput_r, throughput_g, throughput_b;
+    std::vector<rng>        generator;
+    std::vector<hit_record> hits;
+
+    // Queues of path indices
+    std::vector<uint32_t> active;      // Paths still being traced
+    std::vector<uint32_t> next_active; // Paths that survived the current bounce
+    std::vector<uint32_t> sorted;      // Hit paths, grouped by material type
+
+    void trace_batch(const hittable &world, const path_request *requests, size_t count, color *results);
+
+    void generate(const path_request *requests, size_t count);
+
+    void intersect(const hittable &world, color *results);
+
+    void sort_by_material();
+
+    void shade(int bounce);
+
+    /// @details Scatters every path in the bucket of the given type, calling Material::scatter without virtual dispatch.
+    template<typename Material>
+    void shade_bucket(material_type type, int bounce);
+
+    size_t bucket_start[5] = {}; // Start of each material_type bucket in sorted, plus the end of the last
+
+    ray path_ray(const uint32_t path) const
+    {
+        return {point3(origin_x[path], origin_y[path], origin_z[path]), vec3(direction_x[path], direction_y[path], direction_z[path]), time[path]};
+    }
+
+    void set_path_ray(const uint32_t path, const ray &r);
+};
+
+#endif
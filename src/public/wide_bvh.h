@@ -0,0 +1,72 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "includes.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "traversal_stats.h"
+
+#include <vector>
+
+/// Wide BVH Node
+/// @details One node of a wide_bvh with up to Width children. The child boxes are stored structure-of-arrays, one row of Width lower and
+/// upper bounds per axis, so the slab test for four children at a time is a handful of f64x4 loads and operations.
+template<int Width>
+struct wide_bvh_node
+{
+    static_assert(Width % 4 == 0, "wide_bvh_node is tested four children at a time");
+
+    alignas(32) double bounds_min[3][Width]; // Lower bound of every child's box, per axis
+    alignas(32) double bounds_max[3][Width]; // Upper bound of every child's box, per axis
+    uint32_t           offset[Width];        // Leaf child: index of its first primitive. Interior child: index of its node
+    uint16_t           prim_count[Width];    // Primitives in a leaf child; 0 for interior children
+    int                child_count;          // Children in use; the remaining slots are never tested as hits
+};
+
+/// Wide Bounding Volume Hierarchy
+/// @details A bvh_node tree collapsed into nodes of up to Width children (4 for BVH4, 8 for BVH8), in one contiguous array. Each visit
+/// tests every child box of a node with SIMD slab tests, then pushes the children the ray enters onto an explicit stack, farthest first,
+/// so the nearest one is visited next. Children whose entry distance lies behind the closest hit found so far are skipped when popped.
+/// A wide tree is a fraction of the depth of the binary one, so a ray takes far fewer traversal steps and unpredictable branches.
+/// Packets are traced one lane at a time through the single-ray path.
+template<int Width>
+class wide_bvh final : public hittable
+{
+public:
+    /// @details Builds a bvh_node hierarchy over the list, then collapses it.
+    explicit wide_bvh(const hittable_list &list, const bvh_build_options &options = {});
+
+    /// @details Collapses an already built bvh_node hierarchy. A wide tree deeper than the traversal stack can hold is reported and
+    /// leaves this one empty.
+    explicit wide_bvh(const bvh_node &root);
+
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+
+    aabb bounding_box() const override;
+
+    const std::vector<wide_bvh_node<Width> > &node_array() const { return nodes; }
+
+private:
+    static constexpr int traversal_stack_size = 64 * Width; // Most pending children the traversal stack can hold
+    static constexpr int max_depth            = 64;         // Deepest wide tree whose pending children, Width - 1 per level, always fit
+
+    std::vector<wide_bvh_node<Width> > nodes;
+    std::vector<shared_ptr<hittable> > primitives;
+    aabb                               bbox;
+    int                                depth = 0; // Levels of wide nodes
+
+    /// Collapse
+    /// @details Opens up the binary subtree under node, always expanding the interior child with the largest surface area (the one rays
+    /// are most likely to enter) until there are Width children or only leaves are left, then collapses each interior child in turn.
+    /// @param level The depth of the new node, 1 for the root.
+    /// @return The index of the new node.
+    uint32_t collapse(const bvh_node &node, int level);
+};
+
+using bvh4 = wide_bvh<4>;
+using bvh8 = wide_bvh<8>;
+
+#endif